@@ -0,0 +1,255 @@
+#include "apic.h"
+#include "paging.h"
+#include "lib.h"
+#include "smp.h"
+#include "i8259.h"
+
+volatile uint32_t* lapic = 0;
+uint32_t lapic_base = LAPIC_DEFAULT_BASE;
+uint32_t apic_mode = 0;
+uint8_t ioapic_pin[ISA_IRQS] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+static volatile uint32_t* ioapic = 0;
+
+/*
+*   Function: lapic_write(uint32_t reg, uint32_t value)
+*   Description: write a local APIC register and wait for the write to land by reading the id back
+*   inputs: register offset, value
+*   outputs: none
+*   effects:
+*/
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+	lapic[reg >> 2] = value;
+	(void)lapic[LAPIC_ID >> 2];
+}
+
+/*
+*   Function: lapic_init(int32_t bsp)
+*   Description: software enable the local APIC of this cpu so it takes IPIs. Without an I/O APIC
+*                the boot cpu keeps getting the 8259 interrupts through LINT0, the other cpus mask it.
+*   inputs: 1 on the boot cpu
+*   outputs: none
+*   effects: the boot cpu maps the register page for everyone
+*/
+void lapic_init(int32_t bsp)
+{
+	if (bsp) {
+		map_mmio(lapic_base);
+		lapic = (volatile uint32_t*)lapic_base;
+	}
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VEC);
+	lapic_write(LAPIC_LINT0, (bsp && !apic_mode) ? LVT_EXTINT : LVT_MASKED);
+	lapic_write(LAPIC_LINT1, LVT_NMI);
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+*   Function: lapic_id()
+*   Description: local APIC id of the calling cpu
+*   inputs: none
+*   outputs: APIC id
+*   effects:
+*/
+uint8_t lapic_id(void)
+{
+	return lapic[LAPIC_ID >> 2] >> LAPIC_ID_SHIFT;
+}
+
+/*
+*   Function: lapic_eoi()
+*   Description: acknowledge an interrupt delivered by the local APIC: IPIs, its timer and in
+*                APIC mode the device IRQs
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void lapic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+*   Function: lapic_ipi(uint8_t apic_id, uint32_t icr)
+*   Description: send an interprocessor interrupt to one cpu and wait until it is delivered
+*   inputs: destination APIC id, low half of the interrupt command (vector and delivery mode)
+*   outputs: none
+*   effects:
+*/
+void lapic_ipi(uint8_t apic_id, uint32_t icr)
+{
+	lapic_write(LAPIC_ICR_HI, (uint32_t)apic_id << LAPIC_ID_SHIFT);
+	lapic_write(LAPIC_ICR_LO, icr);
+	while (lapic[LAPIC_ICR_LO >> 2] & ICR_PENDING);
+}
+
+/*
+*   Function: lapic_ipi_others(uint32_t icr)
+*   Description: send an interprocessor interrupt to every cpu but the caller
+*   inputs: low half of the interrupt command (vector and delivery mode)
+*   outputs: none
+*   effects:
+*/
+void lapic_ipi_others(uint32_t icr)
+{
+	lapic_write(LAPIC_ICR_HI, 0);
+	lapic_write(LAPIC_ICR_LO, ICR_ALL_BUT_SELF | icr);
+	while (lapic[LAPIC_ICR_LO >> 2] & ICR_PENDING);
+}
+
+/*
+*   Function: lapic_timer_start(uint32_t count, uint32_t periodic)
+*   Description: start the local APIC timer of this cpu, it raises TIMER_VEC after count ticks of
+*                the bus clock divided by 16
+*   inputs: count, 1 to reload the count every time it runs out
+*   outputs: none
+*   effects:
+*/
+void lapic_timer_start(uint32_t count, uint32_t periodic)
+{
+	lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+	lapic_write(LAPIC_TIMER, TIMER_VEC | (periodic ? LVT_PERIODIC : 0));
+	lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+/*
+*   Function: lapic_timer_stop()
+*   Description: stop the local APIC timer of this cpu
+*   inputs: none
+*   outputs: count that was left, 0 if a one-shot already fired
+*   effects:
+*/
+uint32_t lapic_timer_stop(void)
+{
+	uint32_t left = lapic[LAPIC_TIMER_CUR >> 2];
+
+	lapic_write(LAPIC_TIMER_INIT, 0);
+	return left;
+}
+
+/*
+*   Function: lapic_timer_calibrate(uint16_t pit_count)
+*   Description: measure how far the local APIC timer counts while PIT channel 2 counts down
+*                pit_count, by busy waiting on the channel 2 output
+*   inputs: PIT count
+*   outputs: local APIC timer count for the same time
+*   effects: interrupts off, the speaker stays off
+*/
+uint32_t lapic_timer_calibrate(uint16_t pit_count)
+{
+	uint8_t ctrl;
+	uint32_t left;
+
+	ctrl = inb(PIT_CH2_CTRL) & ~(PIT_CH2_SPEAKER | PIT_CH2_GATE);
+	outb(ctrl, PIT_CH2_CTRL);
+	outb(PIT_CH2_ONESHOT, PIT_CMD);
+	outb(pit_count & 0xFF, PIT_CHANNEL_2);
+	outb(pit_count >> 8, PIT_CHANNEL_2);
+
+	lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+	lapic_write(LAPIC_TIMER, LVT_MASKED);
+	outb(ctrl | PIT_CH2_GATE, PIT_CH2_CTRL);		// the rising gate starts channel 2
+	lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+	while (!(inb(PIT_CH2_CTRL) & PIT_CH2_OUT));
+	left = lapic_timer_stop();
+	outb(ctrl, PIT_CH2_CTRL);
+
+	return 0xFFFFFFFF - left;
+}
+
+/*
+*   Function: ioapic_read(uint32_t reg) / ioapic_write(uint32_t reg, uint32_t value)
+*   Description: access an I/O APIC register through the select and window registers
+*   inputs: register index, value
+*   outputs: register value
+*   effects:
+*/
+static uint32_t ioapic_read(uint32_t reg)
+{
+	ioapic[IOAPIC_REGSEL >> 2] = reg;
+	return ioapic[IOAPIC_WIN >> 2];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value)
+{
+	ioapic[IOAPIC_REGSEL >> 2] = reg;
+	ioapic[IOAPIC_WIN >> 2] = value;
+}
+
+/*
+*   Function: ioapic_route(uint32_t irq, uint32_t masked)
+*   Description: point the pin of an ISA IRQ at vector 0x20 + irq on the boot cpu, edge triggered
+*                and active high like the ISA bus
+*   inputs: IRQ number, 1 to mask the pin
+*   outputs: none
+*   effects:
+*/
+static void ioapic_route(uint32_t irq, uint32_t masked)
+{
+	uint32_t reg = IOAPIC_REDIR + 2 * ioapic_pin[irq];
+
+	ioapic_write(reg + 1, (uint32_t)cpus[0].apic_id << LAPIC_ID_SHIFT);
+	ioapic_write(reg, (IRQ_VEC_BASE + irq) | (masked ? LVT_MASKED : 0));
+}
+
+/*
+*   Function: ioapic_enable(uint32_t irq) / ioapic_disable(uint32_t irq)
+*   Description: unmask or mask an ISA IRQ at the I/O APIC. The PIT stays masked, the local APIC
+*                timer ticks on its vector instead, and the cascade has no device.
+*   inputs: IRQ number
+*   outputs: none
+*   effects: APIC mode only
+*/
+void ioapic_enable(uint32_t irq)
+{
+	if (irq < ISA_IRQS && irq != PIT_IRQ && irq != CASCADE_IRQ)
+		ioapic_route(irq, 0);
+}
+
+void ioapic_disable(uint32_t irq)
+{
+	if (irq < ISA_IRQS)
+		ioapic_route(irq, 1);
+}
+
+/*
+*   Function: apic_init()
+*   Description: switch from the 8259 to the I/O APIC when the cpu has a local APIC and the MP
+*                table lists an I/O APIC. Every pin starts masked, the IRQs unmasked so far at the
+*                8259 are unmasked at the I/O APIC, then the 8259 is masked for good.
+*   inputs: none
+*   outputs: none
+*   effects: boot cpu with interrupts off, after paging is on. Sets apic_mode.
+*/
+void apic_init(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t i, pins;
+	uint16_t mask;
+
+	eax = 1;
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	if (!(edx & CPUID_APIC) || ioapic_addr == 0)
+		return;
+
+	map_mmio(ioapic_addr);
+	ioapic = (volatile uint32_t*)ioapic_addr;
+	pins = ((ioapic_read(IOAPIC_VER) >> IOAPIC_MAX_SHIFT) & 0xFF) + 1;
+	for (i = 0; i < pins; i++) {
+		ioapic_write(IOAPIC_REDIR + 2 * i + 1, 0);
+		ioapic_write(IOAPIC_REDIR + 2 * i, LVT_MASKED);
+	}
+
+	apic_mode = 1;
+	lapic_init(1);
+	cpus[0].apic_id = lapic_id();
+	mask = i8259_mask();
+	for (i = 0; i < ISA_IRQS; i++) {
+		if (!(mask & (1 << i)))
+			ioapic_enable(i);
+	}
+	i8259_disable();
+}
@@ -0,0 +1,86 @@
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+
+#define LAPIC_DEFAULT_BASE	0xFEE00000	// local APIC registers, unless the MP table says otherwise
+
+/* local APIC registers, offsets from the base */
+#define LAPIC_ID			0x020
+#define LAPIC_TPR			0x080		// task priority
+#define LAPIC_EOI			0x0B0
+#define LAPIC_SVR			0x0F0		// spurious interrupt vector
+#define LAPIC_ESR			0x280		// error status
+#define LAPIC_ICR_LO		0x300		// interrupt command
+#define LAPIC_ICR_HI		0x310
+#define LAPIC_LINT0			0x350
+#define LAPIC_LINT1			0x360
+#define LAPIC_TIMER			0x320		// LVT entry of the timer
+#define LAPIC_TIMER_INIT	0x380		// initial count, writing it starts the timer
+#define LAPIC_TIMER_CUR		0x390		// current count
+#define LAPIC_TIMER_DIV		0x3E0
+
+#define LAPIC_SVR_ENABLE	0x100
+#define SPURIOUS_VEC		0xFF		// vector of spurious local APIC interrupts, needs no EOI
+#define LAPIC_ID_SHIFT		24
+#define LVT_MASKED			0x10000
+#define LVT_EXTINT			0x700		// LINT0 passes the 8259 INTR through (virtual wire mode)
+#define LVT_NMI				0x400
+#define LVT_PERIODIC		0x20000		// timer reloads the initial count, otherwise one-shot
+#define TIMER_DIV_16		0x3
+#define TIMER_VEC			0x20		// the local APIC timer takes the vector of PIT_IRQ
+
+/* I/O APIC registers, reached through the select and window registers */
+#define IOAPIC_DEFAULT_BASE	0xFEC00000
+#define IOAPIC_REGSEL		0x00
+#define IOAPIC_WIN			0x10
+#define IOAPIC_VER			0x01		// maximum redirection entry in bits 16-23
+#define IOAPIC_REDIR		0x10		// two registers per pin, low half first
+#define IOAPIC_MAX_SHIFT	16
+#define IRQ_VEC_BASE		0x20		// same vectors as the remapped 8259, IRQ n at 0x20 + n
+#define ISA_IRQS			16
+#define PIT_IRQ				0
+#define CASCADE_IRQ			2			// the slave 8259, nothing behind it on the I/O APIC
+#define CPUID_APIC			0x200		// edx bit of cpuid 1, the cpu has a local APIC
+
+/* PIT channel 2, only used to measure the local APIC timer */
+#define PIT_CHANNEL_2		0x42
+#define PIT_CMD				0x43
+#define PIT_CH2_ONESHOT		0xB0		// channel 2, lobyte/hibyte, interrupt on terminal count
+#define PIT_CH2_CTRL		0x61		// bit 0 gates channel 2, bit 1 the speaker
+#define PIT_CH2_GATE		0x01
+#define PIT_CH2_SPEAKER		0x02
+#define PIT_CH2_OUT			0x20		// output of channel 2, set once the count ran out
+
+/* interrupt command register bits */
+#define ICR_FIXED			0x00000
+#define ICR_INIT			0x00500
+#define ICR_STARTUP			0x00600
+#define ICR_PENDING			0x01000		// delivery status
+#define ICR_ASSERT			0x04000
+#define ICR_LEVEL			0x08000
+#define ICR_ALL_BUT_SELF	0xC0000
+
+/* volatile pointer to the mapped registers, 0 while the local APIC is not in use */
+extern volatile uint32_t* lapic;
+extern uint32_t lapic_base;
+
+/* 1 once the interrupts come through the I/O APIC and the 8259 is masked */
+extern uint32_t apic_mode;
+/* I/O APIC pin of every ISA IRQ, the MP table overrides the identity mapping */
+extern uint8_t ioapic_pin[ISA_IRQS];
+
+void lapic_init(int32_t bsp);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_ipi(uint8_t apic_id, uint32_t icr);
+void lapic_ipi_others(uint32_t icr);
+void lapic_timer_start(uint32_t count, uint32_t periodic);
+uint32_t lapic_timer_stop(void);
+uint32_t lapic_timer_calibrate(uint16_t pit_count);
+
+void apic_init(void);
+void ioapic_enable(uint32_t irq);
+void ioapic_disable(uint32_t irq);
+
+#endif
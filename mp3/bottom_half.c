@@ -0,0 +1,98 @@
+#include "bottom_half.h"
+#include "lib.h"
+#include "smp.h"
+
+static bh_ring_t bh_ring[BH_IRQS];
+static volatile uint32_t bh_busy;		// set while some cpu drains the rings
+
+/*
+*   Function: bh_register(uint32_t irq, void (*handler)(uint32_t data))
+*   Description: set the bottom half that handles the records queued for an IRQ
+*   inputs: IRQ number, handler called once per record
+*   outputs: none
+*   effects: called at boot, before the IRQ is enabled
+*/
+void bh_register(uint32_t irq, void (*handler)(uint32_t data))
+{
+	bh_ring[irq].head = 0;
+	bh_ring[irq].tail = 0;
+	bh_ring[irq].dropped = 0;
+	bh_ring[irq].handler = handler;
+}
+
+/*
+*   Function: bh_queue(uint32_t irq, uint32_t data)
+*   Description: top half side, queue one record for the bottom half of the IRQ
+*   inputs: IRQ number, record
+*   outputs: 0 on success, -1 if the ring is full and the record was dropped
+*   effects: interrupt handler of irq, interrupts off
+*/
+int32_t bh_queue(uint32_t irq, uint32_t data)
+{
+	bh_ring_t* ring = &bh_ring[irq];
+	uint32_t head = ring->head;
+
+	if (head - ring->tail == BH_RING_SIZE) {
+		ring->dropped++;
+		return -1;
+	}
+	ring->data[head & (BH_RING_SIZE - 1)] = data;
+	asm volatile("" : : : "memory");	// the record before the new head
+	ring->head = head + 1;
+	return 0;
+}
+
+/*
+*   Function: bh_pending()
+*   Description: check whether any ring holds a record
+*   inputs: none
+*   outputs: 1 if there is work for the bottom halves
+*   effects:
+*/
+static int32_t bh_pending()
+{
+	uint32_t i;
+
+	for (i = 0; i < BH_IRQS; i++) {
+		if (bh_ring[i].head != bh_ring[i].tail)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+*   Function: bh_run()
+*   Description: drain every ring on the way out of an interrupt, with interrupts on so the top
+*                halves keep taking new records. Only one cpu drains at a time, a nested call finds
+*                the rings busy and leaves its records to the running one. The cpu is not preempted
+*                meanwhile, its interrupted context may be the idle task.
+*   inputs: none
+*   outputs: none
+*   effects: interrupts off on entry and return
+*/
+void bh_run(void)
+{
+	bh_ring_t* ring;
+	uint32_t i, busy, data;
+
+	while (bh_pending()) {
+		busy = 1;
+		asm volatile("xchgl %0, %1" : "+r"(busy), "+m"(bh_busy) : : "memory");
+		if (busy)
+			return;
+		this_cpu()->bh_active = 1;
+		sti();
+		for (i = 0; i < BH_IRQS; i++) {
+			ring = &bh_ring[i];
+			while (ring->tail != ring->head) {
+				data = ring->data[ring->tail & (BH_RING_SIZE - 1)];
+				ring->tail++;
+				ring->handler(data);
+			}
+		}
+		cli();
+		this_cpu()->bh_active = 0;
+		bh_busy = 0;
+		// a record queued on another cpu after the last check found bh_busy set, look again
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef _BOTTOM_HALF_H
+#define _BOTTOM_HALF_H
+
+#include "types.h"
+
+#define BH_IRQS			16			// ISA IRQs
+#define BH_RING_SIZE	32			// records per IRQ, a power of two
+
+/* Records an interrupt handler queued for its bottom half. The top half on
+ * the cpu that takes the IRQ is the only producer and whoever runs the
+ * bottom halves the only consumer, so head and tail need no lock. */
+typedef struct bh_ring_t {
+	volatile uint32_t head;			// next free slot, moved by the top half
+	volatile uint32_t tail;			// next record, moved by the bottom half
+	uint32_t data[BH_RING_SIZE];
+	uint32_t dropped;				// records lost to a full ring
+	void (*handler)(uint32_t data);
+} bh_ring_t;
+
+void bh_register(uint32_t irq, void (*handler)(uint32_t data));
+int32_t bh_queue(uint32_t irq, uint32_t data);
+void bh_run(void);
+
+#endif
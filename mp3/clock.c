@@ -0,0 +1,109 @@
+#include "clock.h"
+#include "lib.h"
+#include "apic.h"
+#include "paging.h"
+
+/* The time page gets a frame of its own, nothing else in it becomes visible
+ * to user programs. The kernel half of memory is identity mapped, so its
+ * address is also its physical address. */
+static union {
+	time_page_t tp;
+	uint8_t page[FRAME_SIZE];
+} time_frame __attribute__((aligned(FRAME_SIZE)));
+
+/*
+*   Function: div_u64(uint64_t n, uint32_t d)
+*   Description: 64 by 32 bit division with divl, there is no libgcc to do it for us
+*   inputs: dividend, divisor
+*   outputs: quotient, which must fit in 32 bits
+*   effects: none
+*/
+uint32_t div_u64(uint64_t n, uint32_t d)
+{
+	uint32_t q, r;
+
+	asm("divl %4" : "=a"(q), "=d"(r) : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+	return q;
+}
+
+/*
+*   Function: tsc_calibrate(uint16_t pit_count)
+*   Description: count tsc cycles while PIT channel 2 counts down pit_count, the same way
+*                lapic_timer_calibrate measures the local APIC timer
+*   inputs: PIT count
+*   outputs: tsc cycles for the same time
+*   effects: interrupts off, the speaker stays off
+*/
+static uint64_t tsc_calibrate(uint16_t pit_count)
+{
+	uint64_t start, end;
+	uint8_t ctrl;
+
+	ctrl = inb(PIT_CH2_CTRL) & ~(PIT_CH2_SPEAKER | PIT_CH2_GATE);
+	outb(ctrl, PIT_CH2_CTRL);
+	outb(PIT_CH2_ONESHOT, PIT_CMD);
+	outb(pit_count & 0xFF, PIT_CHANNEL_2);
+	outb(pit_count >> 8, PIT_CHANNEL_2);
+
+	outb(ctrl | PIT_CH2_GATE, PIT_CH2_CTRL);		// the rising gate starts channel 2
+	rdtsc(start);
+	while (!(inb(PIT_CH2_CTRL) & PIT_CH2_OUT));
+	rdtsc(end);
+	outb(ctrl, PIT_CH2_CTRL);
+
+	return end - start;
+}
+
+/*
+*   Function: clock_init()
+*   Description: calibrate the tsc against the PIT, fill in the time page and map it read-only at
+*                TIME_PAGE_ADDR. mult takes the largest shift that still fits 32 bits.
+*   inputs: none
+*   outputs: none
+*   effects: on the boot cpu before the APs copy its page directory, the clock starts at 0
+*/
+void clock_init(void)
+{
+	time_page_t* tp = &time_frame.tp;
+	uint64_t cycles;
+	uint32_t flags, shift;
+
+	cli_and_save(flags);
+	cycles = tsc_calibrate(CLOCK_CAL_COUNT);
+	rdtsc(tp->tsc_base);
+	restore_flags(flags);
+
+	tp->tsc_khz = div_u64(cycles * PIT_HZ, CLOCK_CAL_COUNT * 1000);
+	if (tp->tsc_khz == 0)
+		tp->tsc_khz = 1;
+	for (shift = 32; shift > 0 && (uint32_t)(((uint64_t)NS_PER_MS << shift) >> 32) >= tp->tsc_khz; shift--);
+	tp->shift = shift;
+	tp->mult = div_u64((uint64_t)NS_PER_MS << shift, tp->tsc_khz);
+	tp->ns_base = 0;
+
+	map_time_page(TIME_PAGE_ADDR, (uint32_t)tp);
+}
+
+/*
+*   Function: clock_ns()
+*   Description: the monotonic clock for the kernel, read from the same page as user programs
+*   inputs: none
+*   outputs: nanoseconds since clock_init
+*   effects: none
+*/
+uint64_t clock_ns(void)
+{
+	return time_page_ns(&time_frame.tp);
+}
+
+/*
+*   Function: clock_tick_of(uint64_t ns)
+*   Description: scheduler tick that a time falls into, the time base of the timer wheel
+*   inputs: nanoseconds since boot, less than 2^32 ticks
+*   outputs: ticks since boot
+*   effects: none
+*/
+uint32_t clock_tick_of(uint64_t ns)
+{
+	return div_u64(ns, TICK_NS);
+}
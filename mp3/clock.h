@@ -0,0 +1,51 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include "types.h"
+
+#define TIME_PAGE_ADDR	0x08400000		// 132MB, right above the user program region
+#define PIT_HZ			1193182
+#define CLOCK_CAL_COUNT	59660			// 50ms of PIT counts to calibrate the tsc against
+#define NS_PER_SEC		1000000000
+#define NS_PER_MS		1000000
+#define TICK_NS			10000000		// one scheduler tick, dividor_num PIT counts
+
+/* The time page, mapped read-only at TIME_PAGE_ADDR in every process. It is
+ * written once at boot: nanoseconds since boot are
+ * ns_base + (tsc - tsc_base) * mult / 2^shift. Layout is the user ABI,
+ * fields are only ever appended. */
+typedef struct time_page_t {
+	uint32_t tsc_khz;				// calibrated tsc rate
+	uint32_t mult;					// ns per tsc cycle, scaled by 2^shift
+	uint32_t shift;					// at most 32
+	uint32_t reserved;
+	uint64_t tsc_base;
+	uint64_t ns_base;
+} time_page_t;
+
+/*
+*   Function: time_page_ns(const volatile time_page_t* tp)
+*   Description: monotonic nanoseconds since boot from the time page, without a system call.
+*                The 64 bit tsc delta is scaled as two 32 bit halves so nothing overflows and
+*                no division is needed. User programs use this with (void*)TIME_PAGE_ADDR.
+*   inputs: time page
+*   outputs: nanoseconds since boot
+*   effects: assumes the tsc of every cpu runs at the same constant rate
+*/
+static inline uint64_t time_page_ns(const volatile time_page_t* tp)
+{
+	uint64_t tsc, delta;
+
+	asm volatile("rdtsc" : "=A"(tsc));
+	delta = tsc - tp->tsc_base;
+	return tp->ns_base
+		+ (((delta >> 32) * tp->mult) << (32 - tp->shift))
+		+ (((delta & 0xFFFFFFFF) * tp->mult) >> tp->shift);
+}
+
+void clock_init(void);
+uint64_t clock_ns(void);
+uint32_t clock_tick_of(uint64_t ns);
+uint32_t div_u64(uint64_t n, uint32_t d);
+
+#endif
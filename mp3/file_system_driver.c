@@ -9,6 +9,10 @@
 #define PROGRAM_IMG_ADDRS 0x08048000 
 #define PROGRAM_IMG_OFF   0x00048000
 #define FOUR_MB 0x0400000 
+#define ELF_PHOFF         28                // offsets into the ELF header
+#define ELF_PHNUM         44
+#define ELF_PHDR_SIZE     32
+#define PT_LOAD           1
 boot_block_t* b;
 uint32_t istart;
 static int is_initialized = 0;
@@ -173,7 +177,7 @@ int32_t file_read(int32_t fd, uint8_t* buf, int32_t nbytes)
 
     if(fd < fd_min||fd>fd_max)
         return -1; 
-	pcb_t * new_pcb = Find_PCB(pid); // (pcb_t *)(EIGHT_MB - EIGHT_KB*(pid + 1));
+	pcb_t * new_pcb = Find_PCB(current_pid()); // (pcb_t *)(EIGHT_MB - EIGHT_KB*(pid + 1));
     file_t *new_file = new_pcb->file_array+fd;
     int32_t read_len = read_data(new_file->inode,new_file->f_position,buf,nbytes);
     new_pcb->file_array[fd].f_position += read_len;
@@ -193,7 +197,7 @@ int32_t dir_read(int32_t fd, int8_t* buf, int32_t nbytes)
 	if (fd>fd_max || fd<fd_min || nbytes<0)    // check fd and nbytes validity
 		return -1;
 
-	pcb_t * pcb_new = Find_PCB(pid);		   // get the current pcb
+	pcb_t * pcb_new = Find_PCB(current_pid());		   // get the current pcb
 	uint32_t d_index = pcb_new->file_array[fd].f_position;        // get the file index
 
 	if (d_index < 0)
@@ -357,4 +361,28 @@ void file_loader(dentry_t dir_entry, uint8_t* eip_buf)
     read_data(dir_entry.inodes, 24, eip_buf, 4); //extrapolate entry point into the program
 } 
 
+/* image_end
+ *          DESCRIPTION: find the end of the program image in user memory, including its bss,
+ *                       from the PT_LOAD program headers. This is where the heap starts.
+ *          INPUT:       dir_entry
+ *          OUTPUT:      first address past the image
+ */
+uint32_t image_end(dentry_t dir_entry)
+{
+    inode_t* node = (inode_t*)(istart + BLOCK_SIZE*dir_entry.inodes);
+    uint32_t end = PROGRAM_IMG_ADDRS + node->data_length;
+    uint32_t phoff = 0;
+    uint16_t phnum = 0;
+    uint32_t phdr[ELF_PHDR_SIZE / 4];
+    int i;
 
+    read_data(dir_entry.inodes, ELF_PHOFF, (uint8_t*)&phoff, 4);
+    read_data(dir_entry.inodes, ELF_PHNUM, (uint8_t*)&phnum, 2);
+    for (i = 0; i < phnum; i++) {
+        if (read_data(dir_entry.inodes, phoff + i*ELF_PHDR_SIZE, (uint8_t*)phdr, ELF_PHDR_SIZE) != ELF_PHDR_SIZE)
+            break;
+        if (phdr[0] == PT_LOAD && phdr[2] + phdr[5] > end)     // p_type, p_vaddr + p_memsz
+            end = phdr[2] + phdr[5];
+    }
+    return end;
+}
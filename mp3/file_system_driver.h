@@ -54,5 +54,6 @@ extern void read_test_text();
 //void test_ctl3(uint32_t dir_num);
 uint32_t store_inodes(uint32_t num);
 extern void file_loader(dentry_t dir_entry, uint8_t* eip_buf);
+extern uint32_t image_end(dentry_t dir_entry);
 
 #endif
@@ -0,0 +1,158 @@
+#include "fpu.h"
+#include "lib.h"
+#include "smp.h"
+#include "syscall.h"
+
+/* Lazy FPU switching. schedule_locked sets cr0.TS on every switch, so the
+ * first x87/MMX/SSE instruction of the next process traps to fpu_trap,
+ * which loads its registers. A process that never touches the FPU never
+ * traps and never has its 512 bytes saved. The registers of a process
+ * that did are saved into its pcb when it is switched out, so it can move
+ * to another cpu. Every cpu remembers whose registers it holds, and a
+ * process that comes back to that cpu untouched skips the reload. */
+
+/*
+*   Function: fpu_save(uint8_t* area) / fpu_load(uint8_t* area)
+*   Description: save or load the x87/MMX/SSE registers, fxsave when SSE is on, fnsave otherwise.
+*                fnsave resets the registers, they are loaded back so the cpu still holds them.
+*   inputs: 16 byte aligned area of FPU_STATE_SIZE bytes
+*   outputs: none
+*   effects: cr0.TS clear
+*/
+static void fpu_save(uint8_t* area)
+{
+	if (simd_kind == SIMD_SSE2) {
+		asm volatile("fxsave (%0)" : : "r"(area) : "memory");
+	}
+	else {
+		asm volatile("fnsave (%0)" : : "r"(area) : "memory");
+		asm volatile("frstor (%0)" : : "r"(area) : "memory");
+	}
+}
+
+static void fpu_load(uint8_t* area)
+{
+	if (simd_kind == SIMD_SSE2)
+		asm volatile("fxrstor (%0)" : : "r"(area) : "memory");
+	else
+		asm volatile("frstor (%0)" : : "r"(area) : "memory");
+}
+
+/*
+*   Function: fpu_trap()
+*   Description: device not available (#NM), the running process used the FPU with cr0.TS set.
+*                Clear TS and give it its registers, or fresh ones on its first use.
+*   inputs: none
+*   outputs: none
+*   effects: called by device_not_available_linkage
+*/
+void fpu_trap(void)
+{
+	uint32_t flags, mxcsr = MXCSR_DEFAULT;
+	cpu_t* cpu;
+	pcb_t* pcb;
+
+	cli_and_save(flags);
+	asm volatile("clts");
+	cpu = this_cpu();
+	if (cpu->cur_pid == -1) {
+		printf("FPU used by the idle task on cpu %d\n", cpu->id);
+		while (1);
+	}
+	pcb = Find_PCB(cpu->cur_pid);
+	if (cpu->fpu_owner != cpu->cur_pid || pcb->fpu_cpu != cpu->id || !pcb->fpu_used) {
+		if (pcb->fpu_used) {
+			fpu_load(pcb->fpu_state);
+		}
+		else {
+			asm volatile("fninit");
+			if (simd_kind == SIMD_SSE2)
+				asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+		}
+		cpu->fpu_owner = cpu->cur_pid;
+		pcb->fpu_cpu = cpu->id;
+	}
+	pcb->fpu_used = 1;
+	restore_flags(flags);
+}
+
+/*
+*   Function: fpu_switch_out(int32_t prev)
+*   Description: save the registers of the process being switched out if it used the FPU since
+*                it was switched in, then set cr0.TS for the next one
+*   inputs: pid switched out, -1 for the idle task
+*   outputs: none
+*   effects: interrupts off
+*/
+void fpu_switch_out(int32_t prev)
+{
+	uint32_t cr0;
+
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	if (cr0 & CR0_TS)
+		return;		// nobody trapped since the last switch, the saved registers are current
+	if (prev != -1)
+		fpu_save(Find_PCB(prev)->fpu_state);
+	asm volatile("movl %0, %%cr0" : : "r"(cr0 | CR0_TS));
+}
+
+/*
+*   Function: fpu_save_current()
+*   Description: bring the saved registers of the running process up to date, fork copies them
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void fpu_save_current(void)
+{
+	uint32_t flags, cr0;
+
+	cli_and_save(flags);
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	if (!(cr0 & CR0_TS) && this_cpu()->cur_pid != -1)
+		fpu_save(Find_PCB(this_cpu()->cur_pid)->fpu_state);
+	restore_flags(flags);
+}
+
+/*
+*   Function: kernel_fpu_begin() / kernel_fpu_end()
+*   Description: let the kernel use the FPU registers with interrupts on. The registers of the
+*                running process are saved into its pcb and the cpu no longer counts as holding
+*                them, so its next FPU instruction traps and loads them back. The cpu is not
+*                preempted in between. With interrupts off, in a handler, or inside another
+*                kernel_fpu_begin the caller has to do without the registers.
+*   inputs: none
+*   outputs: kernel_fpu_begin: 1 if the registers may be used, 0 otherwise
+*   effects: cr0.TS clear until kernel_fpu_end
+*/
+int32_t kernel_fpu_begin(void)
+{
+	uint32_t flags, cr0;
+	cpu_t* cpu;
+
+	cli_and_save(flags);
+	cpu = this_cpu();
+	if (!(flags & EFLAGE) || cpu->fpu_kernel) {
+		restore_flags(flags);
+		return 0;
+	}
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	if (!(cr0 & CR0_TS) && cpu->cur_pid != -1)
+		fpu_save(Find_PCB(cpu->cur_pid)->fpu_state);
+	asm volatile("clts");
+	cpu->fpu_owner = -1;
+	cpu->fpu_kernel = 1;
+	restore_flags(flags);
+	return 1;
+}
+
+void kernel_fpu_end(void)
+{
+	uint32_t flags, cr0;
+
+	cli_and_save(flags);
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	asm volatile("movl %0, %%cr0" : : "r"(cr0 | CR0_TS));
+	this_cpu()->fpu_kernel = 0;
+	restore_flags(flags);
+}
@@ -0,0 +1,15 @@
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+
+#define FPU_STATE_SIZE	512			// fxsave area, fnsave uses the first 108 bytes
+#define MXCSR_DEFAULT	0x1F80		// all SIMD exceptions masked, round to nearest
+
+void fpu_trap(void);
+void fpu_switch_out(int32_t prev);
+void fpu_save_current(void);
+int32_t kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif
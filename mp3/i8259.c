@@ -4,6 +4,7 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
 //static unsigned int cached_irq_mask = 0xffff;
 
@@ -41,30 +42,30 @@ i8259_init(void)
 	outb(slave_mask, Slave_Data);  /* restore slave IRQ mask */
 }
 
-/* Enable (unmask) the specified IRQ */
+/* Enable (unmask) the specified IRQ. The masks are kept in
+* master_mask and slave_mask, so only the new mask is written out.
+* In APIC mode the pin is unmasked at the I/O APIC instead */
 //Input: irq_num
 //Output: none
 void
 enable_irq(uint32_t irq_num)
 {
-	//int base_mask = 0x0B;
-	unsigned int mask = 0x1;
+	if (apic_mode)
+	{
+		ioapic_enable(irq_num);
+		return;
+	}
 
 	if (irq_num & 8)
 	{
-		// master_mask &= base_mask;
-		// outb(master_mask,MASTER_8259_PORT+1);
-		mask <<= (irq_num & 7);
-		mask = ~mask;
-		outb((mask & inb(Slave_Data)), Slave_Data);
+		slave_mask &= ~(1 << (irq_num & 7));
+		outb(slave_mask, Slave_Data);
 	}
 	else
 	{
-		mask <<= irq_num;
-		mask = ~mask;
-		outb((mask & inb(Master_Data)), Master_Data);
+		master_mask &= ~(1 << irq_num);
+		outb(master_mask, Master_Data);
 	}
-
 }
 
 /* Disable (mask) the specified IRQ */
@@ -73,17 +74,21 @@ enable_irq(uint32_t irq_num)
 void
 disable_irq(uint32_t irq_num)
 {
-
-	unsigned int mask = 0x1;
+	if (apic_mode)
+	{
+		ioapic_disable(irq_num);
+		return;
+	}
 
 	if (irq_num & 8)
 	{
-		mask <<= (irq_num & 7);
-		outb((mask | inb(Slave_Data)), Slave_Data);
+		slave_mask |= 1 << (irq_num & 7);
+		outb(slave_mask, Slave_Data);
 	}
 	else
 	{
-		outb((mask | inb(Master_Data)), Master_Data);
+		master_mask |= 1 << irq_num;
+		outb(master_mask, Master_Data);
 	}
 }
 
@@ -93,6 +98,11 @@ disable_irq(uint32_t irq_num)
 void
 send_eoi(uint32_t irq_num)
 {
+	if (apic_mode)
+	{
+		lapic_eoi();	/* a single register write, whatever the IRQ */
+		return;
+	}
 
 	if (irq_num & 8)
 	{
@@ -106,3 +116,23 @@ send_eoi(uint32_t irq_num)
 	return;
 }
 
+/* Current masks of both PICs, slave in the high byte */
+//Input: none
+//Output: bit n set while IRQ n is masked
+uint16_t
+i8259_mask(void)
+{
+	return (slave_mask << 8) | master_mask;
+}
+
+/* Mask every IRQ at both PICs once the I/O APIC delivers them */
+//Input: none
+//Output: none
+void
+i8259_disable(void)
+{
+	master_mask = 0xFF;
+	slave_mask = 0xFF;
+	outb(master_mask, Master_Data);
+	outb(slave_mask, Slave_Data);
+}
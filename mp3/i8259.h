@@ -40,6 +40,10 @@ void enable_irq(uint32_t irq_num);
 void disable_irq(uint32_t irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num);
+/* Current IRQ masks, bit n set while IRQ n is masked */
+uint16_t i8259_mask(void);
+/* Mask every IRQ, the I/O APIC takes over */
+void i8259_disable(void);
 
 #endif /* _I8259_H */
 
@@ -1,251 +1,252 @@
 #include "lib.h"
 #include "idt_exception.h"
+#include "paging.h"
+#include "trace.h"
+#include "syscall.h"
 
 /*
-divide_by_zero_eror(void)
-Input: void
-Return Value: none
-Function: print info for divide error exception
+fault(exception_frame_t* f, const char* name, int32_t sig)
+Input: registers at the exception, its name, signal for a user process or -1
+Output: none
+Function: a fault of a user process sends it the signal, which is delivered before the linkage
+returns to it. Without a handler the process is halted, the kernel keeps running. Anything else
+is a kernel bug, print info for it and stop.
 */
-void divide_by_zero_error(void)
+static void fault(exception_frame_t* f, const char* name, int32_t sig)
 {
+	if (sig != -1 && (f->cs & 3) == 3) {
+		if (Find_PCB(current_pid())->sig_handler[sig] == 0)
+			printf("%s\n", name);
+		signal_fault(sig);
+		return;
+	}
 	clear();
-	printf("Divide by Zero Error!\n");
+	printf("%s\n", name);
 	while (1);
 }
 
 /*
-reversed(void)
-Input: void
+divide_by_zero_error(exception_frame_t* f)
+Input: registers at the exception
+Return Value: none
+Function: print info for divide error exception
+*/
+void divide_by_zero_error(exception_frame_t* f)
+{
+	fault(f, "Divide by Zero Error!", SIGFPE);
+}
+
+/*
+reversed(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for reserved exception
 */
-void reversed(void)
+void reversed(exception_frame_t* f)
 {
-	clear();
-	printf("Reversed Exception! (for Intel only)\n");
-	while (1);
+	fault(f, "Reversed Exception! (for Intel only)", -1);
 }
 
 /*
-non_maskable_interrupt(void)
-Input: void
+non_maskable_interrupt(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for nmi exception
 */
-void non_maskable_interrupt(void)
+void non_maskable_interrupt(exception_frame_t* f)
 {
-	clear();
-	printf("Non-Makable Interrupt Exception!\n");
-	while (1);
+	fault(f, "Non-Makable Interrupt Exception!", -1);
 }
 
 /*
-breakpoint(void)
-Input: void
+breakpoint(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for breakpoint exception
 */
-void breakpoint(void)
+void breakpoint(exception_frame_t* f)
 {
-	clear();
-	printf("Breakpoint Exception!\n");
-	while (1);
+	fault(f, "Breakpoint Exception!", SIGSEGV);
 }
 
 /*
-overflow(void)
-Input: void
+overflow(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for overflow exception
 */
-void overflow(void)
+void overflow(exception_frame_t* f)
 {
-	clear();
-	printf("Overflow Exception!\n");
-	while (1);
+	fault(f, "Overflow Exception!", SIGSEGV);
 }
 /*
-bound_range_exceeded(void)
-Input: void
+bound_range_exceeded(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for nmi exception
 */
-void bound_range_exceeded(void)
+void bound_range_exceeded(exception_frame_t* f)
 {
-	clear();
-	printf("Bound Range Exceeded Exception!\n");
-	while (1);
+	fault(f, "Bound Range Exceeded Exception!", SIGSEGV);
 }
 
 /*
-invalid_opcode(void)
-Input: void
+invalid_opcode(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for invalid_opcode exception
 */
-void invalid_opcode(void)
+void invalid_opcode(exception_frame_t* f)
 {
-	clear();
-	printf("Invalid Opcode Exception!\n");
-	while (1);
+	fault(f, "Invalid Opcode Exception!", SIGSEGV);
 }
 
 /*
-device_not+acailabe(void)
-Input: void
-Output: none
-Function: print info for not availabe device exception
-*/
-void device_not_available(void)
-{
-	clear();
-	printf("Deviece is Not Availabe!\n");
-	while (1);
-}
-
-/*
-double_fault(void)
-Input: void
+double_fault(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for double fault exception
 */
-void double_fault(void)
+void double_fault(exception_frame_t* f)
 {
-	clear();
-	printf("Double Fault Exception!\n");
-	while (1);
+	fault(f, "Double Fault Exception!", -1);
 }
 
 /*
-coprocessor_segment_overrun(void)
-Input: void
+coprocessor_segment_overrun(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for coprocessor segment overrun exception
 */
 
-void coprocessor_segment_overrun(void)
+void coprocessor_segment_overrun(exception_frame_t* f)
 {
-	clear();
-	printf("Coprocessor segment Overrun!\n");
-	while (1);
+	fault(f, "Coprocessor segment Overrun!", -1);
 }
 
 /*
-invalid_tss(void)
-Input: void
+invalid_tss(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for invalid tss exception
 */
-void invalid_tss(void)
+void invalid_tss(exception_frame_t* f)
 {
-	clear();
-	printf("Invalid TSS!\n");
-	while (1);
+	fault(f, "Invalid TSS!", -1);
 }
 
 /*
-segment_not_present(void)
-Input: void
+segment_not_present(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for segment to present exception
 */
-void segment_not_present(void)
+void segment_not_present(exception_frame_t* f)
 {
-	clear();
-	printf("Segment Not Present!\n");
-	while (1);
+	fault(f, "Segment Not Present!", SIGSEGV);
 }
 
 /*
-stack_segment_fault(void)
-Input: void
+stack_segment_fault(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for stack segment fault exception
 */
 
-void stack_segment_fault(void)
+void stack_segment_fault(exception_frame_t* f)
 {
-	clear();
-	printf("Stack Segment Fault!\n");
-	while (1);
+	fault(f, "Stack Segment Fault!", SIGSEGV);
 }
 
 /*
-general_protection_fault(void)
-Input: void
+general_protection_fault(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for general protection fault exception
 */
-void general_protection_fault(void)
+void general_protection_fault(exception_frame_t* f)
 {
-	clear();
-	printf("General Protection Fault!\n");
-	while (1);
+	fault(f, "General Protection Fault!", SIGSEGV);
 }
 
 /*
-page_fault(void)
-Input: void
+page_fault(exception_frame_t* f)
+Input: registers at the exception, the faulting address is in cr2
 Output: none
-Function: print info for page fault exception
+Function: resolve demand-zero and copy-on-write faults, any other page fault is a SIGSEGV for a
+user process. A system call that runs into a bad user address halts the process instead of the
+kernel, unless interrupts were off: then a spinlock may be held, which the halt would never drop,
+so that is a kernel bug like a fault on a kernel address.
 */
-void page_fault(void)
+void page_fault(exception_frame_t* f)
 {
+	int32_t cur = current_pid();
+	uint32_t addr;
+
+	asm volatile("movl %%cr2, %0" : "=r"(addr));
+	trace(TRACE_PAGE_FAULT, addr);
+	if (!(f->error_code & PF_PRESENT) && handle_demand_fault(addr) == 0)
+		return;
+	if ((f->error_code & PF_PRESENT) && (f->error_code & PF_WRITE) && handle_cow_fault(addr) == 0)
+		return;
+	if ((f->cs & 3) == 3) {
+		if (Find_PCB(cur)->sig_handler[SIGSEGV] == 0)
+			printf("Page Fault at 0x%x!\n", addr);
+		signal_fault(SIGSEGV);
+		return;
+	}
+	if (addr >= USER_PROG_START && cur != -1 && (f->eflags & EFLAGE)) {
+		printf("Page Fault at 0x%x in a system call!\n", addr);
+		if (this_cpu()->fpu_kernel)		// a copy through the vector registers
+			kernel_fpu_end();
+		process_exit(SIG_KILL_STATUS);
+	}
 	clear();
-	printf("Page Fault!\n");
+	printf("Page Fault at 0x%x!\n", addr);
 	while (1);
 }
 
 /*
-x87fpu_floating_point_error(void)
-Input: void
+x87fpu_floating_point_error(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for x87 floating point error exception
 */
-void x87fpu_floating_point_error(void)
+void x87fpu_floating_point_error(exception_frame_t* f)
 {
-	clear();
-	printf("x87 Floating Point Error!\n");
-	while (1);
+	fault(f, "x87 Floating Point Error!", SIGFPE);
 }
 
 /*
 alignment_checek(void)
-Input: void
+Input: registers at the exception
 Output: none
 Function: print info for alignment check exception
 */
-void alignment_check(void)
+void alignment_check(exception_frame_t* f)
 {
-	clear();
-	printf("Alignemnt Check Exception!\n");
-	while (1);
+	fault(f, "Alignemnt Check Exception!", SIGSEGV);
 }
 
 /*
-nmachine_check(void)
-Input: void
+nmachine_check(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for machine check exception
 */
-void machine_check(void)
+void machine_check(exception_frame_t* f)
 {
-	clear();
-	printf("Machine Check Exception\n");
-	while (1);
+	fault(f, "Machine Check Exception", -1);
 }
 
 /*
-simd_floating_point_exception(void)
-Input: void
+simd_floating_point_exception(exception_frame_t* f)
+Input: registers at the exception
 Output: none
 Function: print info for simd floating point exception
 */
-void simd_floating_point_exception(void)
+void simd_floating_point_exception(exception_frame_t* f)
 {
-	clear();
-	printf("SIMD Floating Point Exception!\n");
-	while (1);
+	fault(f, "SIMD Floating Point Exception!", SIGFPE);
 }
 
@@ -1,6 +1,26 @@
 #ifndef _EXCEPTION_H
 #define _EXCEPTION_H
 
+#include "types.h"
+
+/* Kernel stack of an exception linkage, the C handlers get a pointer to it */
+typedef struct exception_frame_t {
+	uint32_t edi;			// pushal
+	uint32_t esi;
+	uint32_t ebp;
+	uint32_t kernel_esp;
+	uint32_t ebx;
+	uint32_t edx;
+	uint32_t ecx;
+	uint32_t eax;
+	uint32_t error_code;	// 0 for the exceptions without one
+	uint32_t eip;			// pushed by the processor
+	uint32_t cs;
+	uint32_t eflags;
+	uint32_t esp;			// only on an exception in user mode
+	uint32_t ss;
+} exception_frame_t;
+
 /*
 *	Exceptions
 *
@@ -8,43 +28,42 @@
 
 
 /*Vector No. 0x00*/
-extern void divide_by_zero_error(void);
+extern void divide_by_zero_error(exception_frame_t* f);
 /*Vector No. 0x01*/
-extern void reversed(void);
+extern void reversed(exception_frame_t* f);
 /*Vector No. 0x02*/
-extern void non_maskable_interrupt(void);
+extern void non_maskable_interrupt(exception_frame_t* f);
 /*Vector No. 0x03*/
-extern void breakpoint(void);
+extern void breakpoint(exception_frame_t* f);
 /*Vector No. 0x04*/
-extern void overflow(void);
+extern void overflow(exception_frame_t* f);
 /*Vector No. 0x05*/
-extern void bound_range_exceeded(void);
+extern void bound_range_exceeded(exception_frame_t* f);
 /*Vector No. 0x06*/
-extern void invalid_opcode(void);
-/*Vector No. 0x07*/
-extern void device_not_available(void);
+extern void invalid_opcode(exception_frame_t* f);
+/*Vector No. 0x07 is device_not_available_linkage, the lazy FPU restore*/
 /*Vector No. 0x08*/
-extern void double_fault(void);
+extern void double_fault(exception_frame_t* f);
 /*Vector No. 0x09*/
-extern void coprocessor_segment_overrun(void);
+extern void coprocessor_segment_overrun(exception_frame_t* f);
 /*Vector No. 0x0A*/
-extern void invalid_tss(void);
+extern void invalid_tss(exception_frame_t* f);
 /*Vector No. 0x0B*/
-extern void segment_not_present(void);
+extern void segment_not_present(exception_frame_t* f);
 /*Vector No. 0x0C*/
-extern void stack_segment_fault(void);
+extern void stack_segment_fault(exception_frame_t* f);
 /*Vector No. 0x0D*/
-extern void general_protection_fault(void);
+extern void general_protection_fault(exception_frame_t* f);
 /*Vector No. 0x0E*/
-extern void page_fault(void);
+extern void page_fault(exception_frame_t* f);
 /*Vector No. 0x10*/
-extern void x87fpu_floating_point_error(void);
+extern void x87fpu_floating_point_error(exception_frame_t* f);
 /*Vector No. 0x11*/
-extern void alignment_check(void);
+extern void alignment_check(exception_frame_t* f);
 /*Vector No. 0x12*/
-extern void machine_check(void);
+extern void machine_check(exception_frame_t* f);
 /*Vector No. 0x13*/
-extern void simd_floating_point_exception(void);
+extern void simd_floating_point_exception(exception_frame_t* f);
 
 #endif
 
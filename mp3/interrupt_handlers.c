@@ -1,6 +1,8 @@
 #include "interrupt_handlers.h"
+#include "signal.h"
 
 #define KEYBOARD_PORT  0x60
+#define KB_IRQ   1
 #define UPPER_CASE_OFFSET  52
 #define CHAR_TABLE_CORRECTION  2
 
@@ -35,18 +37,62 @@ static int k_offset = 0;
 static uint32_t rtcPrintFlag = 0;
 
 
+static void keyboard_input(unsigned char scancode);
+static void keyboard_bh(uint32_t scancode);
+static void rtc_bh(uint32_t unused);
+
+/*
+ *  handlers_init:
+ *      DESCRIPTION:	register the bottom halves of the keyboard and the RTC
+ *      INPUT:          none
+ *      OUTPUT:         none
+ *      SIDE EFFECTS:   called before the IRQs are enabled
+ */
+void handlers_init(void)
+{
+	bh_register(KB_IRQ, keyboard_bh);
+	bh_register(RTC_IRQ, rtc_bh);
+}
+
 /*
  *  keyboard_handler:
- *      DESCRIPTION:	This function serves keyboard interrupt, scancode will be
- *                      sent to port 0x60 and echo out to the screen, special cases will be handled
+ *      DESCRIPTION:	top half of the keyboard interrupt, read the scancode from port 0x60 and
+ *                      queue it for keyboard_bh, which echoes it and handles the special keys
  *      INPUT:          none
  *      OUTPUT:         none
  */
 void keyboard_handler(void)
+{
+	bh_queue(KB_IRQ, inb(KEYBOARD_PORT));   // obtain scan code from port 0x60
+	send_eoi(KB_IRQ);
+}
+
+/*
+ *  keyboard_bh:
+ *      DESCRIPTION:	bottom half of the keyboard interrupt, runs with interrupts on
+ *      INPUT:          scancode
+ *      OUTPUT:         none
+ */
+static void keyboard_bh(uint32_t scancode)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&term_lock, flags);
+	tlb_sync();
+	keyboard_input(scancode);
+	spin_unlock_irqrestore(&term_lock, flags);
+}
+
+/*
+ *  keyboard_input:
+ *      DESCRIPTION:	echo a scancode to the displayed terminal and keep track of the modifier keys
+ *      INPUT:          scancode
+ *      OUTPUT:         none
+ *      SIDE EFFECTS:   term_lock held
+ */
+static void keyboard_input(unsigned char scancode)
 {
 	int index;
-	unsigned char scancode;
-	scancode = inb(KEYBOARD_PORT);   // obtain scan code from port 0x60
 	uint8_t input;
 	switch(scancode)
 	{
@@ -94,24 +140,19 @@ void keyboard_handler(void)
 		{
 		case F1:
 			// function launch_terminal0
-			send_eoi(1);
 			screen_switch(0);
 			break;
 		case F2:
 			// function launch_terminal1
-			send_eoi(1);
 			screen_switch(1);
 			break;
 		case F3:
 			// function launch_terminal2
-			send_eoi(1);
 			screen_switch(2);
 			break;
 		default: break;
 
 		}
-		send_eoi(1);
-		sti();
 		return;
 	}
 
@@ -120,7 +161,6 @@ void keyboard_handler(void)
 	{
 		input = ' ';
 		printkbd(input);
-		send_eoi(1);
 		return;
 	}
 	 /* Tab press */
@@ -129,7 +169,6 @@ void keyboard_handler(void)
 		uint32_t i;
 		for(i=0; i<4; i++)
 			printkbd(' ');
-		send_eoi(1);
 		return;
 	}
 
@@ -137,7 +176,6 @@ void keyboard_handler(void)
 	if(scancode==BACKSPACE_PRESSED)
 	{
 		print_backspace();
-		send_eoi(1);
 		return;
 	}
 
@@ -146,8 +184,8 @@ void keyboard_handler(void)
 	{
 		input = '\n';
 		printkbd(input);
-		can_read = 1;      //used in terminal_read
-		send_eoi(1);
+		can_read[display_index] = 1;      //used in terminal_read
+		wake_up(&terminal_wq[display_index]);
 		return;
 	}
 	
@@ -176,34 +214,91 @@ void keyboard_handler(void)
 		{
 			clearScreen();
 			update_cursor(0,0);
-			send_eoi(1);
+			return;
+		}
+		// ctrl+c, interrupt the programs of the terminal on screen
+		if(lctrlFlag && (input=='c'||input=='C'))
+		{
+			signal_terminal(display_index, SIGINT);
 			return;
 		}
 	
 		printkbd(input);
 	}
 	END_INTERRUPT:
-		send_eoi(1);
 		return;
 }
 
 //rtc_handler 
-//handle rtc interrupts
+//top half of the rtc interrupt, acknowledge it and leave the readers to rtc_bh
 //Input: none
 //Output: none
 void rtc_handler(void)
 {
+	spin_lock(&rtc_lock);
 	outb(Control_C, RTC_port);
 	inb(CMOS_port);                //dump the data
+	spin_unlock(&rtc_lock);
 	send_eoi(RTC_IRQ);
-	rtc_flag = 0;
-	if (rtcPrintFlag == 1)			//when the ctrl 4 has been pressed
+	bh_queue(RTC_IRQ, 0);
+}
+
+//rtc_bh
+//bottom half of the rtc interrupt, count down the open files and wake their readers
+//Input: none
+//Output: none
+static void rtc_bh(uint32_t unused)
+{
+	static uint32_t print_count = 0;
+	uint32_t flags;
+
+	rtc_tick();
+	if (++print_count < RTC_HW_FREQ / RTC_DEFAULT_FREQ)
+		return;
+	print_count = 0;
+	if (rtcPrintFlag == 1) {		//when the ctrl 4 has been pressed
+		spin_lock_irqsave(&term_lock, flags);
 		printC('1');
+		spin_unlock_irqrestore(&term_lock, flags);
+	}
 }
 
-void pit_handler(void)
+/*
+ *  pit_handler:
+ *      DESCRIPTION:	timer interrupt, the PIT or the local APIC timer. Feeds the profiler
+ *                      before the scheduler tick.
+ *      INPUT:          eip and cs of the interrupted code
+ *      OUTPUT:         none
+ */
+void pit_handler(uint32_t eip, uint32_t cs)
 {
+	prof_sample(eip, cs);
 	scheduling();
 }
 
+/*
+ *  ipi_tick_handler / ipi_resched_handler / ipi_tlb_handler:
+ *      DESCRIPTION:	interprocessor interrupts: a PIT tick forwarded by the boot cpu, a process
+ *                      queued for this cpu by another one, a changed mapping shared by all cpus
+ *      INPUT:          none
+ *      OUTPUT:         none
+ */
+void ipi_tick_handler(void)
+{
+	lapic_eoi();
+	sched_tick(1);
+}
+
+void ipi_resched_handler(void)
+{
+	lapic_eoi();
+	sched_resched();
+}
+
+void ipi_tlb_handler(void)
+{
+	lapic_eoi();
+	tlb_sync();
+}
+
 
@@ -8,6 +8,9 @@
 #include "terminal.h"
 #include "file_system_driver.h"
 #include "scheduling.h"
+#include "apic.h"
+#include "bottom_half.h"
+#include "prof.h"
 
 #define K_NUM     				104
 #define SPECIAL_CHAR            32
@@ -61,9 +64,13 @@ extern uint32_t display_index;
 
 
 extern const unsigned char KEYBOARD_CHAR_TABLE[K_NUM];
+extern void handlers_init(void);
 extern void keyboard_handler(void);
 extern void rtc_handler(void);
-extern void pit_handler(void);
+extern void pit_handler(uint32_t eip, uint32_t cs);
+extern void ipi_tick_handler(void);
+extern void ipi_resched_handler(void);
+extern void ipi_tlb_handler(void);
 
 #endif
 
@@ -3,7 +3,31 @@
 
 extern void keyboard_linkage();
 extern void rtc_linkage();
+extern void serial_linkage();
 extern void pit_linkage();
+extern void page_fault_linkage();
+extern void device_not_available_linkage();
+extern void divide_by_zero_linkage();
+extern void debug_linkage();
+extern void nmi_linkage();
+extern void breakpoint_linkage();
+extern void overflow_linkage();
+extern void bound_range_linkage();
+extern void invalid_opcode_linkage();
+extern void double_fault_linkage();
+extern void coprocessor_overrun_linkage();
+extern void invalid_tss_linkage();
+extern void segment_not_present_linkage();
+extern void stack_segment_linkage();
+extern void general_protection_linkage();
+extern void x87_fpu_linkage();
+extern void alignment_check_linkage();
+extern void machine_check_linkage();
+extern void simd_fpu_linkage();
+extern void ipi_tick_linkage();
+extern void ipi_resched_linkage();
+extern void ipi_tlb_linkage();
+extern void spurious_linkage();
 
 
 #endif
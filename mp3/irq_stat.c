@@ -0,0 +1,199 @@
+#include "irq_stat.h"
+#include "lib.h"
+#include "smp.h"
+#include "procfs.h"
+#include "trace.h"
+#include "serial.h"
+
+#define ISA_VEC_BASE	0x20
+
+static irq_stat_t irq_stat[IRQ_STAT_SLOTS];
+static irq_off_t irq_off[MAX_CPU];
+static const int8_t* irq_name[IRQ_STAT_SLOTS] = {
+	"timer", "keyboard", "cascade", "irq3", "serial", "irq5", "irq6", "irq7",
+	"rtc", "irq9", "irq10", "irq11", "irq12", "irq13", "irq14", "irq15",
+	"ipi tick", "ipi resched", "ipi tlb"
+};
+
+/*
+*   Function: irq_slot(uint32_t vec)
+*   Description: statistics slot of an interrupt vector
+*   inputs: vector
+*   outputs: slot, -1 for a vector that is not counted
+*   effects:
+*/
+static int32_t irq_slot(uint32_t vec)
+{
+	if (vec >= ISA_VEC_BASE && vec < ISA_VEC_BASE + 16)
+		return vec - ISA_VEC_BASE;
+	if (vec >= IPI_TICK && vec <= IPI_TLB)
+		return 16 + vec - IPI_TICK;
+	return -1;
+}
+
+/*
+*   Function: irq_enter(uint32_t vec)
+*   Description: an interrupt handler starts on this cpu, called by its linkage
+*   inputs: vector
+*   outputs: none
+*   effects: interrupts off
+*/
+void irq_enter(uint32_t vec)
+{
+	cpu_t* cpu = this_cpu();
+
+	trace(TRACE_IRQ_ENTER, vec);
+	irq_off[cpu->id].start = 0;			// the interrupt came, so whatever window was open has ended
+	cpu->irq_vec = vec;
+	rdtsc(cpu->irq_start);
+}
+
+/*
+*   Function: irq_exit()
+*   Description: the handler that irq_enter started is done and interrupts come back on, count it.
+*                A handler that switches processes is timed up to the switch, schedule_locked
+*                calls this before the other context runs.
+*   inputs: none
+*   outputs: none
+*   effects: interrupts off
+*/
+void irq_exit(void)
+{
+	cpu_t* cpu = this_cpu();
+	irq_stat_t* stat;
+	uint64_t now;
+	uint32_t cycles, bucket;
+	int32_t slot;
+
+	if (cpu->irq_start == 0)
+		return;
+	trace(TRACE_IRQ_EXIT, cpu->irq_vec);
+	rdtsc(now);
+	cycles = (uint32_t)(now - cpu->irq_start);
+	cpu->irq_start = 0;
+	if (cycles > irq_off[cpu->id].max) {
+		irq_off[cpu->id].max = cycles;
+		irq_off[cpu->id].max_at = cpu->irq_vec;
+		irq_off[cpu->id].max_vec = 1;
+	}
+	slot = irq_slot(cpu->irq_vec);
+	if (slot == -1)
+		return;
+
+	bucket = 0;
+	if (cycles != 0)
+		asm("bsrl %1, %0" : "=r"(bucket) : "rm"(cycles));
+	stat = &irq_stat[slot];
+	asm volatile("lock; incl %0" : "+m"(stat->count));		// the IPIs are counted on every cpu at once
+	asm volatile("lock; incl %0" : "+m"(stat->hist[bucket]));
+	if (cycles > stat->max)
+		stat->max = cycles;
+}
+
+/*
+*   Function: irq_off_begin()
+*   Description: cli_and_save turned interrupts off, start timing the window. Windows opened with
+*                a bare cli() or closed by an iret are not seen.
+*   inputs: none
+*   outputs: none
+*   effects: interrupts off, must not take locks or save flags itself
+*/
+void irq_off_begin(void)
+{
+	irq_off_t* off = &irq_off[this_cpu()->id];
+
+	rdtsc(off->start);
+	off->at = (uint32_t)__builtin_return_address(0);
+}
+
+/*
+*   Function: irq_off_end()
+*   Description: restore_flags is about to turn interrupts back on, keep the window if it is the
+*                longest on this cpu
+*   inputs: none
+*   outputs: none
+*   effects: interrupts off, must not take locks or save flags itself
+*/
+void irq_off_end(void)
+{
+	irq_off_t* off = &irq_off[this_cpu()->id];
+	uint64_t now;
+	uint32_t cycles;
+
+	if (off->start == 0)
+		return;
+	rdtsc(now);
+	cycles = (uint32_t)(now - off->start);
+	off->start = 0;
+	if (cycles > off->max) {
+		off->max = cycles;
+		off->max_at = off->at;
+		off->max_vec = 0;
+	}
+}
+
+/*
+*   Function: irq_stat_show()
+*   Description: print the interrupt statistics for the "irqs" special file. Every vector that fired
+*                gets its count and longest handler time in cycles, followed by the nonzero
+*                buckets of its histogram as log2(cycles):count. Then every cpu gets its longest
+*                interrupts-off window and the code that opened it, or the vector of the handler.
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void irq_stat_show(void)
+{
+	int8_t conv_buf[36];
+	irq_stat_t* stat;
+	uint32_t i, k;
+
+	proc_puts("VEC  NAME            COUNT   HANDLER MAX\n");
+	for (i = 0; i < IRQ_STAT_SLOTS; i++) {
+		stat = &irq_stat[i];
+		if (stat->count == 0)
+			continue;
+		proc_puts("0x");
+		proc_puts(itoa((i < 16) ? ISA_VEC_BASE + i : IPI_TICK + i - 16, conv_buf, 16));
+		proc_puts(" ");
+		proc_puts(irq_name[i]);
+		proc_putu(stat->count, 20 - strlen(irq_name[i]));
+		proc_putu(stat->max, 14);
+		proc_puts("\n    ");
+		for (k = 0; k < IRQ_HIST_BUCKETS; k++) {
+			if (stat->hist[k] == 0)
+				continue;
+			proc_putu(k, 3);
+			proc_puts(":");
+			proc_putu(stat->hist[k], 0);
+		}
+		proc_puts("\n");
+	}
+	proc_puts("CPU  IRQS OFF MAX  AT\n");
+	for (i = 0; i < (uint32_t)cpu_num; i++) {
+		proc_putu(i, 3);
+		proc_putu(irq_off[i].max, 15);
+		proc_puts(irq_off[i].max_vec ? "  vector 0x" : "  0x");
+		proc_puts(itoa(irq_off[i].max_at, conv_buf, 16));
+		proc_puts("\n");
+	}
+}
+
+/*
+*   Function: irq_stat_control(const uint8_t* buf, int32_t nbytes)
+*   Description: write to the "irqs" special file. "serial" sends the same text over the serial
+*                port, so the numbers of a machine whose console is stuck can still be read.
+*   inputs: command, its length
+*   outputs: nbytes, -1 for an unknown command or when there is no UART
+*   effects:
+*/
+int32_t irq_stat_control(const uint8_t* buf, int32_t nbytes)
+{
+	if (nbytes >= 6 && strncmp((int8_t*)buf, "serial", 6) == 0) {
+		if (!serial_present)
+			return -1;
+		proc_serial(irq_stat_show);
+		return nbytes;
+	}
+	return -1;
+}
@@ -0,0 +1,32 @@
+#ifndef _IRQ_STAT_H
+#define _IRQ_STAT_H
+
+#include "types.h"
+
+#define IRQ_STAT_SLOTS		19		// the 16 ISA IRQs and the three IPIs
+#define IRQ_HIST_BUCKETS	32		// bucket k counts durations of 2^k to 2^(k+1)-1 cycles
+
+/* numbers of one interrupt vector */
+typedef struct irq_stat_t {
+	uint32_t count;
+	uint32_t max;					// longest handler, in tsc cycles
+	uint32_t hist[IRQ_HIST_BUCKETS];
+} irq_stat_t;
+
+/* longest interrupts-off window of a cpu, handlers and cli_and_save/restore_flags sections */
+typedef struct irq_off_t {
+	uint64_t start;					// tsc at cli_and_save, 0 outside a window
+	uint32_t at;					// code that called cli_and_save
+	uint32_t max;					// longest window, in tsc cycles
+	uint32_t max_at;				// where it started
+	uint32_t max_vec;				// 1 if it was a handler and max_at is its vector
+} irq_off_t;
+
+void irq_enter(uint32_t vec);
+void irq_exit(void);
+void irq_off_begin(void);
+void irq_off_end(void);
+void irq_stat_show(void);
+int32_t irq_stat_control(const uint8_t* buf, int32_t nbytes);
+
+#endif
@@ -19,6 +19,10 @@
 
 #include "syscall.h"
 #include "scheduling.h"
+#include "smp.h"
+#include "apic.h"
+#include "serial.h"
+#include "clock.h"
 
 
 /* Macros. */
@@ -39,6 +43,7 @@ entry (unsigned long magic, unsigned long addr)
 {
 	multiboot_info_t *mbi;
 	uint32_t file_system_start; //FS
+	uint32_t mem_end = FRAME_POOL_MAX;
 
 	/* Clear the screen. */
 	clear();
@@ -57,9 +62,11 @@ entry (unsigned long magic, unsigned long addr)
 	printf ("flags = 0x%#x\n", (unsigned) mbi->flags);
 
 	/* Are mem_* valid? */
-	if (CHECK_FLAG (mbi->flags, 0))
+	if (CHECK_FLAG (mbi->flags, 0)) {
 		printf ("mem_lower = %uKB, mem_upper = %uKB\n",
 				(unsigned) mbi->mem_lower, (unsigned) mbi->mem_upper);
+		mem_end = (mbi->mem_upper + 1024) * 1024;	// mem_upper counts KB above 1MB
+	}
 
 	/* Is boot_device valid? */
 	if (CHECK_FLAG (mbi->flags, 1))
@@ -202,25 +209,25 @@ entry (unsigned long magic, unsigned long addr)
 	}
 
 		/* Set the exception handler in the IDT 0x00-0x13 (first 19 are defined in the exception_handler)*/
-		SET_IDT_ENTRY(idt[0x00], divide_by_zero_error);
-		SET_IDT_ENTRY(idt[0x01], reversed);
-		SET_IDT_ENTRY(idt[0x02], non_maskable_interrupt);
-		SET_IDT_ENTRY(idt[0x03], breakpoint);
-		SET_IDT_ENTRY(idt[0x04], overflow);
-		SET_IDT_ENTRY(idt[0x05], bound_range_exceeded);
-		SET_IDT_ENTRY(idt[0x06], invalid_opcode);
-		SET_IDT_ENTRY(idt[0x07], device_not_available);
-		SET_IDT_ENTRY(idt[0x08], double_fault);
-		SET_IDT_ENTRY(idt[0x09], coprocessor_segment_overrun);
-		SET_IDT_ENTRY(idt[0x0A], invalid_tss);
-		SET_IDT_ENTRY(idt[0x0B], segment_not_present);
-		SET_IDT_ENTRY(idt[0x0C], stack_segment_fault);
-		SET_IDT_ENTRY(idt[0x0D], general_protection_fault);
-		SET_IDT_ENTRY(idt[0x0E], page_fault);
-		SET_IDT_ENTRY(idt[0x10], x87fpu_floating_point_error);
-		SET_IDT_ENTRY(idt[0x11], alignment_check);
-		SET_IDT_ENTRY(idt[0x12], machine_check);
-		SET_IDT_ENTRY(idt[0x13], simd_floating_point_exception);
+		SET_IDT_ENTRY(idt[0x00], divide_by_zero_linkage);
+		SET_IDT_ENTRY(idt[0x01], debug_linkage);
+		SET_IDT_ENTRY(idt[0x02], nmi_linkage);
+		SET_IDT_ENTRY(idt[0x03], breakpoint_linkage);
+		SET_IDT_ENTRY(idt[0x04], overflow_linkage);
+		SET_IDT_ENTRY(idt[0x05], bound_range_linkage);
+		SET_IDT_ENTRY(idt[0x06], invalid_opcode_linkage);
+		SET_IDT_ENTRY(idt[0x07], device_not_available_linkage);
+		SET_IDT_ENTRY(idt[0x08], double_fault_linkage);
+		SET_IDT_ENTRY(idt[0x09], coprocessor_overrun_linkage);
+		SET_IDT_ENTRY(idt[0x0A], invalid_tss_linkage);
+		SET_IDT_ENTRY(idt[0x0B], segment_not_present_linkage);
+		SET_IDT_ENTRY(idt[0x0C], stack_segment_linkage);
+		SET_IDT_ENTRY(idt[0x0D], general_protection_linkage);
+		SET_IDT_ENTRY(idt[0x0E], page_fault_linkage);
+		SET_IDT_ENTRY(idt[0x10], x87_fpu_linkage);
+		SET_IDT_ENTRY(idt[0x11], alignment_check_linkage);
+		SET_IDT_ENTRY(idt[0x12], machine_check_linkage);
+		SET_IDT_ENTRY(idt[0x13], simd_fpu_linkage);
 	
 		/* Set the interrupt for keyboard in the IDT 0x21 */
 		idt[KBD_PORT].seg_selector = KERNEL_CS;
@@ -246,6 +253,9 @@ entry (unsigned long magic, unsigned long addr)
 		idt[RTC_PORT].seg_selector = KERNEL_CS;
 		SET_IDT_ENTRY(idt[RTC_PORT], rtc_linkage);
 
+		/* COM1 in the IDT 0x24, an interrupt gate as set up above */
+		SET_IDT_ENTRY(idt[SERIAL_VEC], serial_linkage);
+
 		/* Set the interrupt for system call in the IDT 0x80 */
 		{
 		idt[SYS_CALL_VEC].seg_selector = KERNEL_CS;
@@ -270,12 +280,25 @@ entry (unsigned long magic, unsigned long addr)
 		idt[PIT_ENTRY].dpl = 3;
 		idt[PIT_ENTRY].present = 1;
 		SET_IDT_ENTRY(idt[PIT_ENTRY], pit_linkage);
+
+		/* interprocessor interrupts and the local APIC's spurious vector, interrupt gates as above */
+		SET_IDT_ENTRY(idt[IPI_TICK], ipi_tick_linkage);
+		SET_IDT_ENTRY(idt[IPI_RESCHED], ipi_resched_linkage);
+		SET_IDT_ENTRY(idt[IPI_TLB], ipi_tlb_linkage);
+		SET_IDT_ENTRY(idt[SPURIOUS_VEC], spurious_linkage);
 	
+		simd_init();	// SSE2 or MMX memcpy/memset when the cpu has them
 		i8259_init();	 //init the PIC
+		serial_init();	// kernel messages to COM1 from here on
 		
+		smp_init();		// find the other cpus while physical memory is still reachable
 		init_page();	// init paging
+		frame_init(mem_end);	// user frames above 8MB
+		clock_init();	// tsc against the PIT, time page for every process
+		apic_init();	// I/O APIC and local APIC timer in place of the 8259 and the PIT, if there is one
 		sche_init();
 		PIT_init();
+		handlers_init();	// bottom halves of the keyboard and rtc, before their IRQs are on
 		rtc_init();      //call init rtc in rtc.c file
 		//terminal_open(); //call terminal open in terminal.c file 
 		clear();
@@ -283,16 +306,14 @@ entry (unsigned long magic, unsigned long addr)
 
 		fs_initialize(file_system_start); //FS
 
-		for (i = 0; i < 6; i++) {
+		for (i = 0; i < MAX_PROCESS; i++) {
 			pid_status[i] = 0;
 		}
-		pid = -1;
 
 		enable_irq(KB_IRQ);
 		//enable_irq(KB_IRQ);	//enable keyboard (based on IDT master PIC)
-		enable_irq(RTC_IRQ);    //enable RTC	  (based on IDT master PIC)
 		//enable_irq(0);
-		enable_irq(0);			//enable PIT
+		enable_irq(0);			//enable PIT, stays masked in APIC mode
 	
 
 		sti();
@@ -307,11 +328,8 @@ entry (unsigned long magic, unsigned long addr)
 		/*printf("Enabling Interrupts\n");
 		  sti();*/
 
-		/* Execute the first program (`shell') ... */
-		system_execute((uint8_t *) "shell");
-		while (1) {
-
-		}
+		/* Execute the first program (`shell') on every terminal ... */
+		sche_start();
 		/* Spin (nicely, so we don't chew up cycles) */
 		asm volatile(".1: hlt; jmp .1;");
 }
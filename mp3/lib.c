@@ -4,6 +4,8 @@
 
 #include "lib.h"
 #include "terminal.h"
+#include "serial.h"
+#include "fpu.h"
 #define VIDEO 0xB8000
 #define NUM_COLS 80
 #define NUM_ROWS 25
@@ -185,6 +187,7 @@ puts(int8_t* s)
 void
 putc(uint8_t c)
 {
+	serial_log(c);		// every console message also goes to the serial port
 	if (c == '\n' || c == '\r') {
 		screen_y++;
 		screen_x = 0;
@@ -285,16 +288,17 @@ strlen(const int8_t* s)
 }
 
 /*
-* void* memset(void* s, int32_t c, uint32_t n);
+* void* memset_rep(void* s, int32_t c, uint32_t n);
 *   Inputs: void* s = pointer to memory
 *			int32_t c = value to set memory to
 *			uint32_t n = number of bytes to set
 *   Return Value: new string
-*	Function: set n consecutive bytes of pointer s to value c
+*	Function: set n consecutive bytes of pointer s to value c with rep stosl,
+*			  byte stores for the unaligned head and the tail
 */
 
-void*
-memset(void* s, int32_t c, uint32_t n)
+static void*
+memset_rep(void* s, int32_t c, uint32_t n)
 {
 	c &= 0xFF;
 	asm volatile("                  \n\
@@ -332,6 +336,255 @@ memset(void* s, int32_t c, uint32_t n)
 	return s;
 }
 
+/* SIMD copies. simd_init picks SSE2, MMX or nothing from cpuid, copies of
+ * at least SIMD_MIN_SIZE bytes then move 64 bytes per loop through the
+ * vector registers. Copies of SIMD_NT_SIZE and up bypass the cache, they
+ * would only evict what is in it. The registers may hold the state of a
+ * process, so every use is wrapped in kernel_fpu_begin/kernel_fpu_end, and
+ * a copy that cannot have them, with interrupts off, uses rep movsl. */
+uint32_t simd_kind = SIMD_NONE;
+
+/*
+* void simd_cpu_init(void);
+*   Inputs: none
+*   Return Value: none
+*	Function: let this cpu run the instructions simd_init chose: no x87
+*			  emulation, which processes need too, and fxsave/SSE enabled in cr4
+*			  for SSE2
+*/
+
+void
+simd_cpu_init(void)
+{
+	uint32_t cr;
+
+	asm volatile("movl %%cr0, %0" : "=r"(cr));
+	cr = (cr & ~CR0_EM) | CR0_MP;
+	asm volatile("movl %0, %%cr0" : : "r"(cr));
+	asm volatile("fninit");
+	if (simd_kind == SIMD_SSE2) {
+		asm volatile("movl %%cr4, %0" : "=r"(cr));
+		cr |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+		asm volatile("movl %0, %%cr4" : : "r"(cr));
+	}
+}
+
+/*
+* void simd_init(void);
+*   Inputs: none
+*   Return Value: none
+*	Function: pick the copy routines from the cpuid feature bits and set up the
+*			  boot cpu, the others call simd_cpu_init when they start
+*/
+
+void
+simd_init(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	if ((edx & CPUID_SSE2) && (edx & CPUID_FXSR))
+		simd_kind = SIMD_SSE2;
+	else if (edx & CPUID_MMX)
+		simd_kind = SIMD_MMX;
+	simd_cpu_init();
+}
+
+/*
+* void simd_copy(uint8_t* dest, const uint8_t* src, uint32_t blocks, uint32_t nt);
+*   Inputs: dest = 16 byte aligned destination, src = source,
+*			blocks = number of 64 byte blocks, nt = 1 for stores around the cache
+*   Return Value: none
+*	Function: copy whole blocks, between kernel_fpu_begin and kernel_fpu_end
+*/
+
+static void
+simd_copy(uint8_t* dest, const uint8_t* src, uint32_t blocks, uint32_t nt)
+{
+	if (simd_kind == SIMD_SSE2 && nt) {
+		asm volatile("                          \n\
+				1:                              \n\
+				movdqu  (%0), %%xmm0            \n\
+				movdqu  16(%0), %%xmm1          \n\
+				movdqu  32(%0), %%xmm2          \n\
+				movdqu  48(%0), %%xmm3          \n\
+				movntdq %%xmm0, (%1)            \n\
+				movntdq %%xmm1, 16(%1)          \n\
+				movntdq %%xmm2, 32(%1)          \n\
+				movntdq %%xmm3, 48(%1)          \n\
+				addl    $64, %0                 \n\
+				addl    $64, %1                 \n\
+				decl    %2                      \n\
+				jnz     1b                      \n\
+				sfence                          \n\
+				"
+				: "+r"(src), "+r"(dest), "+r"(blocks)
+				:
+				: "memory", "cc"
+				);
+	}
+	else if (simd_kind == SIMD_SSE2) {
+		asm volatile("                          \n\
+				1:                              \n\
+				movdqu  (%0), %%xmm0            \n\
+				movdqu  16(%0), %%xmm1          \n\
+				movdqu  32(%0), %%xmm2          \n\
+				movdqu  48(%0), %%xmm3          \n\
+				movdqa  %%xmm0, (%1)            \n\
+				movdqa  %%xmm1, 16(%1)          \n\
+				movdqa  %%xmm2, 32(%1)          \n\
+				movdqa  %%xmm3, 48(%1)          \n\
+				addl    $64, %0                 \n\
+				addl    $64, %1                 \n\
+				decl    %2                      \n\
+				jnz     1b                      \n\
+				"
+				: "+r"(src), "+r"(dest), "+r"(blocks)
+				:
+				: "memory", "cc"
+				);
+	}
+	else {
+		asm volatile("                          \n\
+				1:                              \n\
+				movq    (%0), %%mm0             \n\
+				movq    8(%0), %%mm1            \n\
+				movq    16(%0), %%mm2           \n\
+				movq    24(%0), %%mm3           \n\
+				movq    32(%0), %%mm4           \n\
+				movq    40(%0), %%mm5           \n\
+				movq    48(%0), %%mm6           \n\
+				movq    56(%0), %%mm7           \n\
+				movq    %%mm0, (%1)             \n\
+				movq    %%mm1, 8(%1)            \n\
+				movq    %%mm2, 16(%1)           \n\
+				movq    %%mm3, 24(%1)           \n\
+				movq    %%mm4, 32(%1)           \n\
+				movq    %%mm5, 40(%1)           \n\
+				movq    %%mm6, 48(%1)           \n\
+				movq    %%mm7, 56(%1)           \n\
+				addl    $64, %0                 \n\
+				addl    $64, %1                 \n\
+				decl    %2                      \n\
+				jnz     1b                      \n\
+				"
+				: "+r"(src), "+r"(dest), "+r"(blocks)
+				:
+				: "memory", "cc"
+				);
+	}
+}
+
+/*
+* void simd_fill(uint8_t* dest, uint32_t c, uint32_t blocks, uint32_t nt);
+*   Inputs: dest = 16 byte aligned destination, c = byte value repeated in all
+*			four bytes, blocks = number of 64 byte blocks, nt = 1 for stores
+*			around the cache
+*   Return Value: none
+*	Function: fill whole blocks, between kernel_fpu_begin and kernel_fpu_end
+*/
+
+static void
+simd_fill(uint8_t* dest, uint32_t c, uint32_t blocks, uint32_t nt)
+{
+	if (simd_kind == SIMD_SSE2) {
+		asm volatile("                          \n\
+				movd    %3, %%xmm0              \n\
+				pshufd  $0, %%xmm0, %%xmm0      \n\
+				testl   %2, %2                  \n\
+				jnz     2f                      \n\
+				1:                              \n\
+				movdqa  %%xmm0, (%0)            \n\
+				movdqa  %%xmm0, 16(%0)          \n\
+				movdqa  %%xmm0, 32(%0)          \n\
+				movdqa  %%xmm0, 48(%0)          \n\
+				addl    $64, %0                 \n\
+				decl    %1                      \n\
+				jnz     1b                      \n\
+				jmp     3f                      \n\
+				2:                              \n\
+				movntdq %%xmm0, (%0)            \n\
+				movntdq %%xmm0, 16(%0)          \n\
+				movntdq %%xmm0, 32(%0)          \n\
+				movntdq %%xmm0, 48(%0)          \n\
+				addl    $64, %0                 \n\
+				decl    %1                      \n\
+				jnz     2b                      \n\
+				sfence                          \n\
+				3:                              \n\
+				"
+				: "+r"(dest), "+r"(blocks)
+				: "r"(nt), "r"(c)
+				: "memory", "cc"
+				);
+	}
+	else {
+		asm volatile("                          \n\
+				movd    %2, %%mm0               \n\
+				punpckldq %%mm0, %%mm0          \n\
+				1:                              \n\
+				movq    %%mm0, (%0)             \n\
+				movq    %%mm0, 8(%0)            \n\
+				movq    %%mm0, 16(%0)           \n\
+				movq    %%mm0, 24(%0)           \n\
+				movq    %%mm0, 32(%0)           \n\
+				movq    %%mm0, 40(%0)           \n\
+				movq    %%mm0, 48(%0)           \n\
+				movq    %%mm0, 56(%0)           \n\
+				addl    $64, %0                 \n\
+				decl    %1                      \n\
+				jnz     1b                      \n\
+				"
+				: "+r"(dest), "+r"(blocks)
+				: "r"(c)
+				: "memory", "cc"
+				);
+	}
+}
+
+/*
+* void* memset_simd(void* s, int32_t c, uint32_t n);
+*   Inputs: void* s = pointer to memory
+*			int32_t c = value to set memory to
+*			uint32_t n = number of bytes to set, at least SIMD_MIN_SIZE
+*   Return Value: new string
+*	Function: set the aligned middle with the vector registers, the rest with memset_rep.
+*			  Called after kernel_fpu_begin, ends it.
+*/
+
+static void*
+memset_simd(void* s, int32_t c, uint32_t n)
+{
+	uint8_t* dest = (uint8_t*)s;
+	uint32_t head, blocks;
+
+	c &= 0xFF;
+	head = (SIMD_ALIGN - ((uint32_t)dest & (SIMD_ALIGN - 1))) & (SIMD_ALIGN - 1);
+	memset_rep(dest, c, head);
+	blocks = (n - head) / SIMD_BLOCK;
+	simd_fill(dest + head, c << 24 | c << 16 | c << 8 | c, blocks, n >= SIMD_NT_SIZE);
+	kernel_fpu_end();
+	memset_rep(dest + head + blocks * SIMD_BLOCK, c, n - head - blocks * SIMD_BLOCK);
+	return s;
+}
+
+/*
+* void* memset(void* s, int32_t c, uint32_t n);
+*   Inputs: void* s = pointer to memory
+*			int32_t c = value to set memory to
+*			uint32_t n = number of bytes to set
+*   Return Value: new string
+*	Function: set n consecutive bytes of pointer s to value c
+*/
+
+void*
+memset(void* s, int32_t c, uint32_t n)
+{
+	if (simd_kind == SIMD_NONE || n < SIMD_MIN_SIZE || !kernel_fpu_begin())
+		return memset_rep(s, c, n);
+	return memset_simd(s, c, n);
+}
+
 /*
 * void* memset_word(void* s, int32_t c, uint32_t n);
 *   Inputs: void* s = pointer to memory
@@ -386,16 +639,17 @@ memset_dword(void* s, int32_t c, uint32_t n)
 }
 
 /*
-* void* memcpy(void* dest, const void* src, uint32_t n);
+* void* memcpy_rep(void* dest, const void* src, uint32_t n);
 *   Inputs: void* dest = destination of copy
 *			const void* src = source of copy
 *			uint32_t n = number of byets to copy
 *   Return Value: pointer to dest
-*	Function: copy n bytes of src to dest
+*	Function: copy n bytes of src to dest with rep movsl, byte moves for the
+*			  unaligned head and the tail
 */
 
-void*
-memcpy(void* dest, const void* src, uint32_t n)
+static void*
+memcpy_rep(void* dest, const void* src, uint32_t n)
 {
 	asm volatile("                  \n\
 			.memcpy_top:            \n\
@@ -436,6 +690,49 @@ memcpy(void* dest, const void* src, uint32_t n)
 	return dest;
 }
 
+/*
+* void* memcpy_simd(void* dest, const void* src, uint32_t n);
+*   Inputs: void* dest = destination of copy
+*			const void* src = source of copy
+*			uint32_t n = number of byets to copy, at least SIMD_MIN_SIZE
+*   Return Value: pointer to dest
+*	Function: copy the part where dest is aligned with the vector registers, the
+*			  rest with memcpy_rep. Called after kernel_fpu_begin, ends it.
+*/
+
+static void*
+memcpy_simd(void* dest, const void* src, uint32_t n)
+{
+	uint8_t* d = (uint8_t*)dest;
+	const uint8_t* s = (const uint8_t*)src;
+	uint32_t head, blocks;
+
+	head = (SIMD_ALIGN - ((uint32_t)d & (SIMD_ALIGN - 1))) & (SIMD_ALIGN - 1);
+	memcpy_rep(d, s, head);
+	blocks = (n - head) / SIMD_BLOCK;
+	simd_copy(d + head, s + head, blocks, n >= SIMD_NT_SIZE);
+	kernel_fpu_end();
+	memcpy_rep(d + head + blocks * SIMD_BLOCK, s + head + blocks * SIMD_BLOCK, n - head - blocks * SIMD_BLOCK);
+	return dest;
+}
+
+/*
+* void* memcpy(void* dest, const void* src, uint32_t n);
+*   Inputs: void* dest = destination of copy
+*			const void* src = source of copy
+*			uint32_t n = number of byets to copy
+*   Return Value: pointer to dest
+*	Function: copy n bytes of src to dest
+*/
+
+void*
+memcpy(void* dest, const void* src, uint32_t n)
+{
+	if (simd_kind == SIMD_NONE || n < SIMD_MIN_SIZE || !kernel_fpu_begin())
+		return memcpy_rep(dest, src, n);
+	return memcpy_simd(dest, src, n);
+}
+
 /*
 * void* memmove(void* dest, const void* src, uint32_t n);
 *   Inputs: void* dest = destination of move
@@ -6,6 +6,25 @@
 #define _LIB_H
 
 #include "types.h"
+#include "irq_stat.h"
+
+/* SIMD memcpy and memset */
+#define SIMD_NONE			0
+#define SIMD_MMX			1
+#define SIMD_SSE2			2
+#define SIMD_MIN_SIZE		256			// smaller copies stay with rep movsl
+#define SIMD_NT_SIZE		0x40000		// larger copies do not go through the cache
+#define SIMD_BLOCK			64			// bytes per loop
+#define SIMD_ALIGN			16
+#define CPUID_MMX			0x00800000	// edx bits of cpuid 1
+#define CPUID_FXSR			0x01000000
+#define CPUID_SSE2			0x04000000
+#define CR0_MP				0x00000002
+#define CR0_EM				0x00000004
+#define CR0_TS				0x00000008
+#define CR4_OSFXSR			0x00000200
+#define CR4_OSXMMEXCPT		0x00000400
+#define EFLAGS_IF			0x00000200
 
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
@@ -23,6 +42,9 @@ void* memset_word(void* s, int32_t c, uint32_t n);
 void* memset_dword(void* s, int32_t c, uint32_t n);
 void* memcpy(void* dest, const void* src, uint32_t n);
 void* memmove(void* dest, const void* src, uint32_t n);
+extern uint32_t simd_kind;		// SIMD_NONE, SIMD_MMX or SIMD_SSE2
+void simd_init(void);
+void simd_cpu_init(void);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
@@ -112,7 +134,8 @@ do {                                    \
 
 /* Save flags and then clear interrupt flag
 * Saves the EFLAGS register into the variable "flags", and then
-* disables interrupts on this processor */
+* disables interrupts on this processor. When they were on, the
+* interrupts-off window starts here for irq_stat */
 #define cli_and_save(flags)             \
 do {                                    \
 	asm volatile("pushfl        \n      \
@@ -122,6 +145,18 @@ do {                                    \
 			:                       \
 			: "memory", "cc"        \
 			);                      \
+	if ((flags) & EFLAGS_IF)            \
+		irq_off_begin();                \
+} while(0)
+
+/* Read the time stamp counter into the 64 bit variable "tsc" */
+#define rdtsc(tsc)                      \
+do {                                    \
+	asm volatile("rdtsc"                \
+			: "=A"(tsc)             \
+			:                       \
+			: "memory"              \
+			);                      \
 } while(0)
 
 /* Set interrupt flag - enable interrupts on this processor */
@@ -136,9 +171,12 @@ do {                                    \
 
 /* Restore flags
 * Puts the value in "flags" into the EFLAGS register.  Most often used
-* after a cli_and_save_flags(flags) */
+* after a cli_and_save_flags(flags). Turning interrupts back on ends the
+* window cli_and_save started */
 #define restore_flags(flags)            \
 do {                                    \
+	if ((flags) & EFLAGS_IF)            \
+		irq_off_end();                  \
 	asm volatile("pushl %0      \n      \
 			popfl"                  \
 			:                       \
@@ -0,0 +1,42 @@
+#include "mutex.h"
+#include "syscall.h"
+
+/*
+*   Function: mutex_lock(mutex_t* m)
+*   Description: take the mutex, sleeping while another process holds it
+*   inputs: mutex
+*   outputs: none
+*   effects: may sleep
+*/
+void mutex_lock(mutex_t* m)
+{
+	uint32_t flags;
+	int32_t waited = 0;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	while (m->owner != -1) {
+		waited = 1;
+		sleep_on(&m->wq);
+	}
+	m->owner = current_pid();
+	spin_unlock_irqrestore(&sched_lock, flags);
+	lock_stat_acquired(&m->stat, waited);
+}
+
+/*
+*   Function: mutex_unlock(mutex_t* m)
+*   Description: release the mutex and wake the processes waiting for it, the first one to run gets it
+*   inputs: mutex
+*   outputs: none
+*   effects: 
+*/
+void mutex_unlock(mutex_t* m)
+{
+	uint32_t flags;
+
+	lock_stat_released(&m->stat);
+	spin_lock_irqsave(&sched_lock, flags);
+	m->owner = -1;
+	wake_up_locked(&m->wq);
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
@@ -0,0 +1,22 @@
+#ifndef _MUTEX_H
+#define _MUTEX_H
+
+#include "types.h"
+#include "spinlock.h"
+#include "wait_queue.h"
+
+/* Sleeping lock for process context. A process that finds it taken sleeps
+ * until the holder lets go, so it may be held across long copies, page faults
+ * and wait_event. Never taken by interrupt handlers or the idle task. */
+typedef struct mutex_t {
+	volatile int32_t owner;			// pid of the holder, -1 when free
+	wait_queue_t wq;				// processes waiting for it
+	lock_stat_t stat;
+} mutex_t;
+
+#define MUTEX_INIT(name)	{ -1, { 0 }, { name, 0, 0, 0, 0, 0, 0 } }
+
+void mutex_lock(mutex_t* m);
+void mutex_unlock(mutex_t* m);
+
+#endif
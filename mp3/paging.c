@@ -1,4 +1,7 @@
 #include "paging.h"
+#include "lib.h"
+#include "smp.h"
+#include "spinlock.h"
 
 /* PG - Paging flag, bit 31 of CR0
 * PSE- Page size extension, bit 4 of CR4
@@ -27,9 +30,35 @@
 #define RW 0x00000002	//not present
 #define pm_size 4096	//memory size for pages in page table --> 4kB
 #define FOUR_MB_PRESENT 0x83
+#define CR0_WP          0x00010000       // supervisor writes honour read-only pages (needed for COW)
+#define PRESENT         0x01
+#define PAGE_PWT        0x08             // write-through
+#define PAGE_PCD        0x10             // cache disable, for memory mapped registers
+#define PDE_SHIFT       22
+#define PTE_SHIFT       12
+#define PTE_IDX_MASK    0x3FF
+#define FLAG_MASK       0xFFF
+#define FRAME_IDX(f)    (((f) - FRAME_POOL_START) / FRAME_SIZE)
 
 static unsigned int cr0, cr3, cr4;
 
+/* one 4KB page table per pid for the 4MB user program region at 128MB */
+static uint32_t user_prog_table[MAX_PROCESS][PTE_num] __attribute__((aligned(PTE_size)));
+/* one 4KB page table per pid for the shared memory window at 136MB */
+static uint32_t user_shm_table[MAX_PROCESS][PTE_num] __attribute__((aligned(PTE_size)));
+/* 4KB page table for the 4MB above the user program region, shared by every process */
+static uint32_t user_time_table[PTE_num] __attribute__((aligned(PTE_size)));
+static uint8_t frame_ref[FRAME_NUM];	// number of user page tables referencing each frame
+static uint32_t frame_count;			// frames actually backed by memory
+static uint32_t frame_next;				// next-fit search start
+static uint32_t user_brk[MAX_PROCESS];	// end of each pid's heap, pages below it are demand-zero
+static uint32_t user_image_end[MAX_PROCESS];	// initial break, the heap cannot shrink below the image
+/* guards the frame pool and the user page tables, faults on other cpus share both */
+static spinlock_t mem_lock = SPINLOCK_INIT("mem");
+
+static uint32_t frame_alloc_locked();
+static void frame_put_locked(uint32_t frame);
+
 
 /* init_page()
 * 		DESCRIPTION: The function initialize paging, by setting page directory and page table. 
@@ -63,6 +92,10 @@ void init_page()
 									  // a single 4M_Byte page shoule be refered directly from page directory 
 	page_dir[1] |= PAGE_4MB_ENABLE | RW_PRESENT | PAGE_4MB_ADDR;  // 4MB page starting from 0x400000
 
+	// identity map the frame pool (supervisor only) so the kernel can copy and clear user frames
+	for (i = FRAME_POOL_START >> PDE_SHIFT; i < FRAME_POOL_MAX >> PDE_SHIFT; i++)
+		page_dir[i] = (i << PDE_SHIFT) | PAGE_4MB_ENABLE | RW_PRESENT;
+
     // set page size extension in bit 4 of cr4
 	asm volatile ("mov %%cr4,%0" : "=r"(cr4));   // native_read_cr4
 	cr4 |= CR4_BIT4;							 // set bit 4
@@ -87,7 +120,7 @@ void enable_paging()
 		:"=r"(cr3) 
 		:"r"(cr3));
 	asm volatile("mov %%cr0,%0;" : "=r"(cr0));
-	cr0 |= CR0_BIT31;						// set paging flag in cr0
+	cr0 |= CR0_BIT31 | CR0_WP;				// set paging flag and write protect in cr0
 	asm volatile("mov %0, %%cr0"::"r"(cr0));
 }
 
@@ -97,12 +130,334 @@ void enable_paging()
 *		INPUT:       pid
 *		OUTPUT:      none
 */
-void map_user_prog(uint8_t pid) {
+void map_user_prog(uint8_t p) {
+
+	cpu_t* cpu;
+	uint32_t flags;
+
+	if (p >= MAX_PROCESS)
+		return;
+	cli_and_save(flags);		// stay on this cpu's page directory
+	cpu = this_cpu();
+	cpu->page_dir[USER_PAGE] = (uint32_t)user_prog_table[p] | USER | RW_PRESENT; 	//map user level
+	cpu->page_dir[USER_SHM_START >> PDE_SHIFT] = (uint32_t)user_shm_table[p] | USER | RW_PRESENT;
+	cpu->mapped_pid = p;
+
+	flush_tlb();
+	restore_flags(flags);
+}
+
+/*
+*   void init_user_prog
+*		DESCRIPTION: start pid with an empty user program region. Pages below brk (image and heap)
+*					 and in the stack area are backed with zeroed frames on first touch.
+*		INPUT:       pid, initial program break
+*		OUTPUT:      none
+*/
+void init_user_prog(uint8_t p, uint32_t brk)
+{
+	int i;
+
+	for (i = 0; i < PTE_num; i++)
+		user_prog_table[p][i] = RW_NOT_PRESENT | BASE;
+	user_brk[p] = brk;
+	user_image_end[p] = brk;
+}
+
+/*
+*   int32_t set_user_brk
+*		DESCRIPTION: move pid's program break. Growing only moves the limit, the page fault handler
+*					 backs the pages later; shrinking releases the pages above the new break.
+*		INPUT:       pid, new program break
+*		OUTPUT:      0 on success, -1 if the break would leave the heap area, below the end of
+*					 the program image or into the stack area
+*/
+int32_t set_user_brk(uint8_t p, uint32_t brk)
+{
+	uint32_t idx, flags;
+
+	if (brk < user_image_end[p] || brk > USER_STACK_LIMIT)
+		return -1;
+	spin_lock_irqsave(&mem_lock, flags);
+	for (idx = (brk - USER_PROG_START + FRAME_SIZE - 1) >> PTE_SHIFT;
+			idx < (user_brk[p] - USER_PROG_START + FRAME_SIZE - 1) >> PTE_SHIFT; idx++) {
+		if (user_prog_table[p][idx] & PRESENT)
+			frame_put_locked(user_prog_table[p][idx] & PT_MASK);
+		user_prog_table[p][idx] = RW_NOT_PRESENT | BASE;
+	}
+	user_brk[p] = brk;
+	flush_tlb();
+	spin_unlock_irqrestore(&mem_lock, flags);
+	return 0;
+}
+
+/*
+*   uint32_t get_user_brk
+*		DESCRIPTION: current program break of pid
+*		INPUT:       pid
+*		OUTPUT:      program break
+*/
+uint32_t get_user_brk(uint8_t p)
+{
+	return user_brk[p];
+}
+
+/*
+*   void free_user_prog
+*		DESCRIPTION: drop pid's reference to every frame of its user program region
+*		INPUT:       pid
+*		OUTPUT:      none
+*/
+void free_user_prog(uint8_t p)
+{
+	uint32_t flags;
+	int i;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	for (i = 0; i < PTE_num; i++) {
+		if (user_prog_table[p][i] & PRESENT)
+			frame_put_locked(user_prog_table[p][i] & PT_MASK);
+		user_prog_table[p][i] = RW_NOT_PRESENT | BASE;
+	}
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
 
-	uint32_t addr = FOUR_MB * pid + ADDR_8MB;
-	page_dir[USER_PAGE] = addr|USER|RW_PRESENT|PAGE_4MB_ENABLE; 	//map user level
+/*
+*   void fork_user_prog
+*		DESCRIPTION: share parent's user pages with child. Writable pages become read-only
+*					 copy-on-write in both tables and are copied by the page fault handler.
+*		INPUT:       parent pid, child pid
+*		OUTPUT:      none
+*/
+void fork_user_prog(uint8_t parent, uint8_t child)
+{
+	uint32_t pte, flags;
+	int i;
 
+	spin_lock_irqsave(&mem_lock, flags);
+	for (i = 0; i < PTE_num; i++) {
+		pte = user_prog_table[parent][i];
+		if (pte & PRESENT) {
+			if (pte & RW)
+				pte = (pte & ~RW) | PTE_COW;
+			frame_ref[FRAME_IDX(pte & PT_MASK)]++;
+		}
+		user_prog_table[parent][i] = pte;
+		user_prog_table[child][i] = pte;
+	}
+	user_brk[child] = user_brk[parent];
+	user_image_end[child] = user_image_end[parent];
 	flush_tlb();
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
+
+/*
+*   int32_t handle_cow_fault
+*		DESCRIPTION: resolve a write fault on a copy-on-write page of the mapped user program.
+*					 The last sharer takes the frame over, everyone else gets a private copy.
+*		INPUT:       faulting linear address
+*		OUTPUT:      0 if the fault was resolved, -1 if it was not a copy-on-write fault
+*/
+int32_t handle_cow_fault(uint32_t addr)
+{
+	uint32_t* pte;
+	uint32_t old_frame, new_frame, flags;
+	int32_t mapped_pid, ret = -1;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	mapped_pid = this_cpu()->mapped_pid;
+	if ((addr >> PDE_SHIFT) != USER_PAGE || mapped_pid == -1)
+		goto out;
+	pte = &user_prog_table[mapped_pid][(addr >> PTE_SHIFT) & PTE_IDX_MASK];
+	if (!(*pte & PRESENT) || !(*pte & PTE_COW))
+		goto out;
+
+	old_frame = *pte & PT_MASK;
+	if (frame_ref[FRAME_IDX(old_frame)] == 1) {
+		*pte = (*pte & ~PTE_COW) | RW;
+	}
+	else {
+		new_frame = frame_alloc_locked();
+		if (new_frame == 0)
+			goto out;
+		memcpy((void*)new_frame, (void*)old_frame, FRAME_SIZE);
+		frame_put_locked(old_frame);
+		*pte = new_frame | ((*pte & FLAG_MASK) & ~PTE_COW) | RW;
+	}
+	asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+	ret = 0;
+out:
+	spin_unlock_irqrestore(&mem_lock, flags);
+	return ret;
+}
+
+/*
+*   int32_t handle_demand_fault
+*		DESCRIPTION: back a not-present page of the mapped user program with a zeroed frame,
+*					 as long as it lies below the program break or in the stack area
+*		INPUT:       faulting linear address
+*		OUTPUT:      0 if the fault was resolved, -1 for a bad address or an empty pool
+*/
+int32_t handle_demand_fault(uint32_t addr)
+{
+	uint32_t* pte;
+	uint32_t frame, flags;
+	int32_t mapped_pid, ret = -1;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	mapped_pid = this_cpu()->mapped_pid;
+	if ((addr >> PDE_SHIFT) != USER_PAGE || mapped_pid == -1)
+		goto out;
+	if (addr >= user_brk[mapped_pid] && addr < USER_STACK_LIMIT)
+		goto out;
+	pte = &user_prog_table[mapped_pid][(addr >> PTE_SHIFT) & PTE_IDX_MASK];
+	if (*pte & PRESENT)
+		goto out;
+
+	frame = frame_alloc_locked();
+	if (frame == 0)
+		goto out;
+	memset((void*)frame, 0, FRAME_SIZE);
+	*pte = frame | USER | RW_PRESENT;
+	asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+	ret = 0;
+out:
+	spin_unlock_irqrestore(&mem_lock, flags);
+	return ret;
+}
+
+/*
+*   int32_t check_user_range
+*		DESCRIPTION: check a buffer a system call got from the running process, so a bad pointer
+*					 makes the call return -1 instead of faulting in the kernel, where a fault
+*					 with a spinlock held cannot be recovered. The buffer has to lie in the user
+*					 program region, each page present or one that handle_demand_fault backs, or
+*					 in the shared memory window on attached pages. For a buffer the kernel
+*					 writes, copy-on-write pages are copied here and other read-only pages are
+*					 refused, the write would fault on them.
+*		INPUT:       start of the buffer, its size, 1 if the kernel writes it
+*		OUTPUT:      0 if the buffer may be used, -1 otherwise
+*/
+int32_t check_user_range(const void* ptr, uint32_t size, int32_t write)
+{
+	uint32_t addr = (uint32_t)ptr;
+	uint32_t page, low, pte, flags;
+	int32_t mapped_pid, shm, ok;
+
+	if (addr >= USER_PROG_START && addr < USER_PROG_END && size <= USER_PROG_END - addr)
+		shm = 0;
+	else if (addr >= USER_SHM_START && addr < USER_SHM_END && size <= USER_SHM_END - addr)
+		shm = 1;
+	else
+		return -1;
+	for (page = addr & ~(FRAME_SIZE - 1); page < addr + size; page += FRAME_SIZE) {
+		low = (page < addr) ? addr : page;
+		spin_lock_irqsave(&mem_lock, flags);
+		mapped_pid = this_cpu()->mapped_pid;
+		if (mapped_pid == -1) {
+			pte = 0;
+			ok = 0;
+		}
+		else if (shm) {
+			pte = user_shm_table[mapped_pid][(page >> PTE_SHIFT) & PTE_IDX_MASK];
+			ok = pte & PRESENT;
+		}
+		else {
+			pte = user_prog_table[mapped_pid][(page >> PTE_SHIFT) & PTE_IDX_MASK];
+			ok = (pte & PRESENT) || low < user_brk[mapped_pid] || low >= USER_STACK_LIMIT;
+		}
+		spin_unlock_irqrestore(&mem_lock, flags);
+		if (!ok)
+			return -1;
+		if (write && (pte & PRESENT) && !(pte & RW) && (shm || handle_cow_fault(low) == -1))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+*   void frame_init
+*		DESCRIPTION: set up the user frame pool, clipped to the installed memory
+*		INPUT:       physical end of memory
+*		OUTPUT:      none
+*/
+void frame_init(uint32_t mem_end)
+{
+	int i;
+
+	if (mem_end > FRAME_POOL_MAX)
+		mem_end = FRAME_POOL_MAX;
+	frame_count = (mem_end > FRAME_POOL_START) ? (mem_end - FRAME_POOL_START) / FRAME_SIZE : 0;
+	frame_next = 0;
+	for (i = 0; i < FRAME_NUM; i++)
+		frame_ref[i] = 0;
+}
+
+/*
+*   uint32_t frame_alloc
+*		DESCRIPTION: grab a free 4KB frame from the pool
+*		INPUT:       none
+*		OUTPUT:      physical address of the frame, 0 if none is left
+*/
+uint32_t frame_alloc()
+{
+	uint32_t frame, flags;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	frame = frame_alloc_locked();
+	spin_unlock_irqrestore(&mem_lock, flags);
+	return frame;
+}
+
+static uint32_t frame_alloc_locked()
+{
+	uint32_t i, idx;
+
+	for (i = 0; i < frame_count; i++) {
+		idx = (frame_next + i) % frame_count;
+		if (frame_ref[idx] == 0) {
+			frame_ref[idx] = 1;
+			frame_next = idx + 1;
+			return FRAME_POOL_START + idx * FRAME_SIZE;
+		}
+	}
+	return 0;
+}
+
+/*
+*   void frame_get
+*		DESCRIPTION: take one more reference to an allocated frame
+*		INPUT:       physical address of the frame
+*		OUTPUT:      none
+*/
+void frame_get(uint32_t frame)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	frame_ref[FRAME_IDX(frame)]++;
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
+
+/*
+*   void frame_put
+*		DESCRIPTION: drop one reference to a frame, it returns to the pool at zero
+*		INPUT:       physical address of the frame
+*		OUTPUT:      none
+*/
+void frame_put(uint32_t frame)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	frame_put_locked(frame);
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
+
+static void frame_put_locked(uint32_t frame)
+{
+	if (frame_ref[FRAME_IDX(frame)] > 0)
+		frame_ref[FRAME_IDX(frame)]--;
 }
 
 /* 
@@ -119,6 +474,22 @@ void flush_tlb()
 		:::"memory", "cc");
 }
 
+/* 
+ * set_user_pte()
+ *		DESCRIPTION: Installs a user page table for the 4MB block holding the virtual address and
+ *					 sets the entry for that address. Called with mem_lock held, which keeps us on this cpu.
+ *		INPUT:       page table, virtual Address, page table entry
+ *		OUTPUT:      none
+ */ 
+
+static void set_user_pte(uint32_t* table, uint32_t virtualAddr, uint32_t pte)
+{
+    uint32_t PDE_index = virtualAddr>>22;	//get top 10 bits of pde index
+    this_cpu()->page_dir[PDE_index] = (uint32_t)table | USER | RW_PRESENT;
+    table[(virtualAddr >> PTE_SHIFT) & PTE_IDX_MASK] = pte;
+    flush_tlb();
+}
+
 /* 
  * map_video_mem()
  *		DESCRIPTION: Maps the 4KB memory at the given virtual address to the first page of the user page table
@@ -128,15 +499,90 @@ void flush_tlb()
 
 void map_video_mem(uint32_t virtualAddr, uint32_t physicalAddr)
 {
-	
-    uint32_t PDE_index = virtualAddr>>22;	//get top 10 bits of pde index
-    page_dir[PDE_index] = (uint32_t)user_page_table | USER | RW_PRESENT;
-    user_page_table[0] = physicalAddr | USER | RW_PRESENT; // attributes: user, read/write, present
-    flush_tlb();
+	uint32_t flags;
+	int i;
 
+	spin_lock_irqsave(&mem_lock, flags);
+	// attributes: user, read/write, present
+	set_user_pte(user_page_table, virtualAddr, physicalAddr | USER | RW_PRESENT);
+	// the table is shared, every cpu sees it at the same place
+	for (i = 0; i < cpu_num; i++)
+		cpus[i].page_dir[virtualAddr >> PDE_SHIFT] = (uint32_t)user_page_table | USER | RW_PRESENT;
+	tlb_shootdown();
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
+
+/* 
+ * map_shm_page()
+ *		DESCRIPTION: Maps a shared memory frame into pid's shared memory window, a frame of 0 unmaps the page.
+ *					 The caller owns the frame reference counting.
+ *		INPUT:       pid, virtual Address, physical address of the frame
+ *		OUTPUT:      none
+ */ 
+
+void map_shm_page(uint8_t p, uint32_t virtualAddr, uint32_t frame)
+{
+	uint32_t pte = (frame != 0) ? (frame | USER | RW_PRESENT) : (RW_NOT_PRESENT | BASE);
+	uint32_t flags;
+
+	spin_lock_irqsave(&mem_lock, flags);
+	if (p == this_cpu()->mapped_pid)
+		set_user_pte(user_shm_table[p], virtualAddr, pte);
+	else
+		user_shm_table[p][(virtualAddr >> PTE_SHIFT) & PTE_IDX_MASK] = pte;
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
+
+/* 
+ * shm_page()
+ *		DESCRIPTION: Looks up the page table entry for an address of pid's shared memory window
+ *		INPUT:       pid, virtual Address
+ *		OUTPUT:      page table entry
+ */ 
+
+uint32_t shm_page(uint8_t p, uint32_t virtualAddr)
+{
+	return user_shm_table[p][(virtualAddr >> PTE_SHIFT) & PTE_IDX_MASK];
 }
 void vid_new(uint32_t addr, int display_index)
 {
+	uint32_t flags;
+
+	spin_lock_irqsave(&mem_lock, flags);
 	page_table[VIDEO_IDX + display_index * 2] = addr | USER_RW; 	//set to user level
+	tlb_shootdown();
+	spin_unlock_irqrestore(&mem_lock, flags);
+}
+
+/* 
+ * map_time_page()
+ *		DESCRIPTION: Maps a kernel page read-only for every process, for the clock to publish the time.
+ *					 Done on the boot cpu before the others copy its page directory.
+ *		INPUT:       virtual Address, physical Address
+ *		OUTPUT:      none
+ */ 
+
+void map_time_page(uint32_t virtualAddr, uint32_t physicalAddr)
+{
+	int i;
+
+	for (i = 0; i < PTE_num; i++)
+		user_time_table[i] = RW_NOT_PRESENT | BASE;
+	user_time_table[(virtualAddr >> PTE_SHIFT) & PTE_IDX_MASK] = physicalAddr | USER | PRESENT;
+	page_dir[virtualAddr >> PDE_SHIFT] = (uint32_t)user_time_table | USER | RW_PRESENT;
+	flush_tlb();
+}
+
+/* 
+ * map_mmio()
+ *		DESCRIPTION: Identity maps the 4MB block holding a memory mapped device, uncached and
+ *					 supervisor only. Done on the boot cpu before the others copy its page directory.
+ *		INPUT:       physical Address
+ *		OUTPUT:      none
+ */ 
+
+void map_mmio(uint32_t physicalAddr)
+{
+	page_dir[physicalAddr >> PDE_SHIFT] = (physicalAddr & ~(PAGE_4MB_ADDR - 1)) | PAGE_PCD | PAGE_PWT | PAGE_4MB_ENABLE | RW_PRESENT;
 	flush_tlb();
 }
@@ -8,6 +8,24 @@
 #define PDE_size  PDE_num*4		// 4B for each pde entry 
 #define PTE_size  PTE_num*4		// 4B for each pte entry 
 
+#define MAX_PROCESS 	8				// number of pids, each owns one user page table
+#define FRAME_SIZE		0x1000			// 4KB physical frame
+#define FRAME_POOL_START 0x0800000		// 8MB, first frame handed out to user programs
+#define FRAME_POOL_MAX	0x4000000		// 64MB, end of the identity mapped frame pool
+#define FRAME_NUM		((FRAME_POOL_MAX - FRAME_POOL_START) / FRAME_SIZE)
+#define PTE_COW			0x200			// avail bit 9, page is shared copy-on-write
+#define USER_PROG_START	0x08000000		// 128MB, user program region served by user_prog_table
+#define USER_PROG_END	0x08400000		// 132MB
+#define USER_STACK_SIZE	0x00100000		// stack pages are demand-zero in the top 1MB
+#define USER_STACK_LIMIT (USER_PROG_END - USER_STACK_SIZE)
+#define USER_SHM_START	0x08800000		// 136MB, 4MB window for attached shared memory segments
+#define USER_SHM_END	0x08C00000		// 140MB
+
+/* page fault error code bits */
+#define PF_PRESENT		0x1
+#define PF_WRITE		0x2
+#define PF_USER			0x4
+
 uint32_t page_dir[PDE_num] __attribute__((aligned(PDE_size)));
 
 /*********************************************************
@@ -38,11 +56,27 @@ uint32_t user_page_table[PTE_num] __attribute__((aligned(PTE_size)));
 
 extern void init_page();
 extern void enable_paging();
-extern void map_user_prog(uint8_t pid);
+extern void map_user_prog(uint8_t p);
 extern void flush_tlb();
+extern void frame_init(uint32_t mem_end);
+extern uint32_t frame_alloc();
+extern void frame_get(uint32_t frame);
+extern void frame_put(uint32_t frame);
+extern void init_user_prog(uint8_t p, uint32_t brk);
+extern int32_t set_user_brk(uint8_t p, uint32_t brk);
+extern uint32_t get_user_brk(uint8_t p);
+extern void free_user_prog(uint8_t p);
+extern void fork_user_prog(uint8_t parent, uint8_t child);
+extern int32_t handle_cow_fault(uint32_t addr);
+extern int32_t handle_demand_fault(uint32_t addr);
+extern int32_t check_user_range(const void* ptr, uint32_t size, int32_t write);
 extern void map_video_mem(uint32_t virtualAddr, uint32_t physicalAddr);
+extern void map_shm_page(uint8_t p, uint32_t virtualAddr, uint32_t frame);
+extern uint32_t shm_page(uint8_t p, uint32_t virtualAddr);
 
 extern void vid_new(uint32_t addr, int display_index);
+extern void map_time_page(uint32_t virtualAddr, uint32_t physicalAddr);
+extern void map_mmio(uint32_t physicalAddr);
 
 
 #endif
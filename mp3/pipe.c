@@ -0,0 +1,255 @@
+#include "pipe.h"
+#include "paging.h"
+#include "syscall.h"
+
+/* Ring buffer. head and tail run freely, the difference is the number of
+ * buffered bytes. After a fork several processes may read or write the same
+ * end, possibly on different cpus, so the indices and the end counts are
+ * changed under pipe_lock. Readers and writers that cannot make progress
+ * sleep on the wait queues. */
+typedef struct pipe_t {
+	volatile uint32_t head;		// next byte to write
+	volatile uint32_t tail;		// next byte to read
+	volatile uint32_t readers;	// open read ends, 0 when the slot is free
+	volatile uint32_t writers;	// open write ends
+	uint8_t* buf;
+	wait_queue_t readq;			// readers waiting for data
+	wait_queue_t writeq;		// writers waiting for room
+} pipe_t;
+
+static pipe_t pipes[PIPE_MAX];
+static spinlock_t pipe_lock = SPINLOCK_INIT("pipe");
+
+/*
+*   int32_t pipe_create(void)
+*   	DESCRIPTION: 	set up an empty pipe with one read end and one write end
+*   	INPUT: 			none
+*		OUTPUT: 		pipe id, -1 if no pipe or buffer frame is left
+*/
+int32_t pipe_create(void)
+{
+	uint32_t flags;
+	int32_t i;
+
+	spin_lock_irqsave(&pipe_lock, flags);
+	for (i = 0; i < PIPE_MAX; i++) {
+		if (pipes[i].readers == 0 && pipes[i].writers == 0) {
+			pipes[i].buf = (uint8_t*)frame_alloc();
+			if (pipes[i].buf == NULL)
+				break;
+			pipes[i].head = 0;
+			pipes[i].tail = 0;
+			pipes[i].readers = 1;
+			pipes[i].writers = 1;
+			pipes[i].readq.waiters = 0;
+			pipes[i].writeq.waiters = 0;
+			spin_unlock_irqrestore(&pipe_lock, flags);
+			return i;
+		}
+	}
+	spin_unlock_irqrestore(&pipe_lock, flags);
+	return -1;
+}
+
+/*
+*   void pipe_dup(int32_t id, int32_t write_end)
+*   	DESCRIPTION: 	one more fd refers to an end of the pipe (fork)
+*   	INPUT: 			pipe id, which end
+*		OUTPUT: 		none
+*/
+void pipe_dup(int32_t id, int32_t write_end)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&pipe_lock, flags);
+	if (write_end)
+		pipes[id].writers++;
+	else
+		pipes[id].readers++;
+	spin_unlock_irqrestore(&pipe_lock, flags);
+}
+
+/*
+*   int32_t pipe_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+*   	DESCRIPTION: 	wait until the pipe holds data, then copy out as much as is buffered. Another
+*						reader may empty the pipe between the wakeup and the copy, then we wait again.
+*   	INPUT: 			fd, buffer, bytes wanted
+*		OUTPUT: 		bytes read, 0 at end of file (empty and no writer left), -1 for a bad buffer
+*						or when a signal came first
+*/
+int32_t pipe_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+{
+	pipe_t* p = &pipes[Find_PCB(current_pid())->file_array[fd].inode];
+	int32_t count = 0, ret;
+	uint32_t flags;
+
+	if (nbytes <= 0)
+		return 0;
+	if (check_user_range(buf, nbytes, 1) == -1)		// the copy runs under pipe_lock, it must not fault
+		return -1;
+	while (1) {
+		wait_event_interruptible(&p->readq, p->head != p->tail || p->writers == 0, ret);
+		if (ret == -1)
+			return -1;
+		spin_lock_irqsave(&pipe_lock, flags);
+		if (p->head != p->tail || p->writers == 0)
+			break;
+		spin_unlock_irqrestore(&pipe_lock, flags);
+	}
+
+	while (count < nbytes && p->head != p->tail) {
+		buf[count++] = p->buf[p->tail % PIPE_SIZE];
+		p->tail++;
+	}
+	spin_unlock_irqrestore(&pipe_lock, flags);
+	wake_up(&p->writeq);
+	return count;
+}
+
+/*
+*   int32_t pipe_write(int32_t fd, const uint8_t* buf, int32_t nbytes)
+*   	DESCRIPTION: 	copy the whole buffer into the pipe, waiting for room when it is full
+*   	INPUT: 			fd, buffer, bytes to write
+*		OUTPUT: 		bytes written, -1 for a bad buffer, if there is no reader left or a signal
+*						came before any byte was written
+*/
+int32_t pipe_write(int32_t fd, const uint8_t* buf, int32_t nbytes)
+{
+	pipe_t* p = &pipes[Find_PCB(current_pid())->file_array[fd].inode];
+	int32_t count = 0, ret;
+	uint32_t flags;
+
+	if (nbytes < 0 || check_user_range(buf, nbytes, 0) == -1)
+		return -1;
+	while (count < nbytes) {
+		if (p->head - p->tail == PIPE_SIZE) {
+			wake_up(&p->readq);
+			wait_event_interruptible(&p->writeq, p->head - p->tail != PIPE_SIZE || p->readers == 0, ret);
+			if (ret == -1)
+				return (count != 0) ? count : -1;
+		}
+		spin_lock_irqsave(&pipe_lock, flags);
+		if (p->readers == 0) {
+			spin_unlock_irqrestore(&pipe_lock, flags);
+			return (count != 0) ? count : -1;
+		}
+		// fill what is free now, another writer may have taken the room we woke up for
+		while (count < nbytes && p->head - p->tail != PIPE_SIZE) {
+			p->buf[p->head % PIPE_SIZE] = buf[count++];
+			p->head++;
+		}
+		spin_unlock_irqrestore(&pipe_lock, flags);
+	}
+	wake_up(&p->readq);
+	return count;
+}
+
+/*
+*   int32_t pipe_open(void)
+*   	DESCRIPTION: 	pipes are created by the pipe system call, not opened by name
+*   	INPUT: 			none
+*		OUTPUT: 		-1
+*/
+int32_t pipe_open(void)
+{
+	return -1;
+}
+
+/*
+*   void pipe_release(int32_t id, int32_t write_end)
+*   	DESCRIPTION: 	drop one end of the pipe, the buffer is freed with the last end
+*   	INPUT: 			pipe id, which end
+*		OUTPUT: 		none
+*/
+void pipe_release(int32_t id, int32_t write_end)
+{
+	pipe_t* p = &pipes[id];
+	uint32_t flags;
+
+	spin_lock_irqsave(&pipe_lock, flags);
+	if (write_end) {
+		if (--p->writers == 0 && p->readers == 0)
+			frame_put((uint32_t)p->buf);
+		wake_up(&p->readq);		// readers see end of file once the last writer is gone
+	}
+	else {
+		if (--p->readers == 0 && p->writers == 0)
+			frame_put((uint32_t)p->buf);
+		wake_up(&p->writeq);	// writers fail once the last reader is gone
+	}
+	spin_unlock_irqrestore(&pipe_lock, flags);
+}
+
+/*
+*   int32_t pipe_read_close(int32_t fd) / pipe_write_close(int32_t fd)
+*   	DESCRIPTION: 	close the read or write end held by fd
+*   	INPUT: 			fd
+*		OUTPUT: 		0
+*/
+int32_t pipe_read_close(int32_t fd)
+{
+	pipe_release(Find_PCB(current_pid())->file_array[fd].inode, 0);
+	return 0;
+}
+
+int32_t pipe_write_close(int32_t fd)
+{
+	pipe_release(Find_PCB(current_pid())->file_array[fd].inode, 1);
+	return 0;
+}
+
+/*
+*   int32_t pipe_read_poll(int32_t fd, poll_table_t* pt) / pipe_write_poll(int32_t fd, poll_table_t* pt)
+*   	DESCRIPTION: 	readiness of the end held by fd for poll. A read at end of file and a write
+*   					without readers return at once, so both count as ready.
+*   	INPUT: 			fd, poll table
+*		OUTPUT: 		POLLIN with data or POLLIN | POLLHUP without writers for the read end,
+*   					POLLOUT with room or POLLOUT | POLLERR without readers for the write end
+*/
+int32_t pipe_read_poll(int32_t fd, poll_table_t* pt)
+{
+	pipe_t* p = &pipes[Find_PCB(current_pid())->file_array[fd].inode];
+	int32_t ev = 0;
+	uint32_t flags;
+
+	poll_wait(pt, &p->readq);
+	spin_lock_irqsave(&pipe_lock, flags);
+	if (p->head != p->tail)
+		ev |= POLLIN;
+	if (p->writers == 0)
+		ev |= POLLIN | POLLHUP;
+	spin_unlock_irqrestore(&pipe_lock, flags);
+	return ev;
+}
+
+int32_t pipe_write_poll(int32_t fd, poll_table_t* pt)
+{
+	pipe_t* p = &pipes[Find_PCB(current_pid())->file_array[fd].inode];
+	int32_t ev = 0;
+	uint32_t flags;
+
+	poll_wait(pt, &p->writeq);
+	spin_lock_irqsave(&pipe_lock, flags);
+	if (p->head - p->tail != PIPE_SIZE)
+		ev |= POLLOUT;
+	if (p->readers == 0)
+		ev |= POLLOUT | POLLERR;
+	spin_unlock_irqrestore(&pipe_lock, flags);
+	return ev;
+}
+
+/*
+*   int32_t pipe_bad_read / pipe_bad_write
+*   	DESCRIPTION: 	the write end cannot be read and the read end cannot be written
+*   	INPUT: 			fd, buffer, bytes
+*		OUTPUT: 		-1
+*/
+int32_t pipe_bad_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+{
+	return -1;
+}
+
+int32_t pipe_bad_write(int32_t fd, const uint8_t* buf, int32_t nbytes)
+{
+	return -1;
+}
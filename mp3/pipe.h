@@ -0,0 +1,25 @@
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "poll.h"
+
+#define PIPE_MAX	8			// number of pipes in the system
+#define PIPE_SIZE	0x1000		// ring buffer size, one pool frame
+
+int32_t pipe_create(void);
+void pipe_dup(int32_t id, int32_t write_end);
+void pipe_release(int32_t id, int32_t write_end);
+
+/* pipe file operations */
+int32_t pipe_read(int32_t fd, uint8_t* buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const uint8_t* buf, int32_t nbytes);
+int32_t pipe_open(void);
+int32_t pipe_read_close(int32_t fd);
+int32_t pipe_write_close(int32_t fd);
+int32_t pipe_read_poll(int32_t fd, poll_table_t* pt);
+int32_t pipe_write_poll(int32_t fd, poll_table_t* pt);
+int32_t pipe_bad_read(int32_t fd, uint8_t* buf, int32_t nbytes);
+int32_t pipe_bad_write(int32_t fd, const uint8_t* buf, int32_t nbytes);
+
+#endif
@@ -0,0 +1,130 @@
+#include "poll.h"
+#include "syscall.h"
+#include "timer.h"
+#include "clock.h"
+
+/* The readiness callbacks run without sched_lock, they take the locks of
+ * their devices. So that a wakeup between a callback and the sleep is not
+ * lost, poll_wait puts the caller on each wait queue before the callback
+ * looks at its device. A wake_up meanwhile takes the caller off that queue
+ * again, which poll sees under sched_lock and polls once more instead of
+ * sleeping. A caller asleep on several queues is woken by the first of them
+ * and takes itself off the others. */
+
+/*
+*   Function: poll_wait(poll_table_t* pt, wait_queue_t* wq)
+*   Description: a readiness callback tells poll which wait queue signals a change of its file
+*   inputs: table of the poll in progress, 0 when nobody will sleep, wait queue
+*   outputs: none
+*   effects: the caller is on the wait queue from now on
+*/
+void poll_wait(poll_table_t* pt, wait_queue_t* wq)
+{
+	uint32_t flags;
+	int32_t i;
+
+	if (pt == NULL || wq == NULL)
+		return;
+	for (i = 0; i < pt->n; i++) {
+		if (pt->wq[i] == wq)
+			return;
+	}
+	if (pt->n == POLL_MAX_WQ)
+		return;
+	pt->wq[pt->n++] = wq;
+	spin_lock_irqsave(&sched_lock, flags);
+	wq->waiters |= 1 << current_pid();
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: poll_always(int32_t fd, poll_table_t* pt)
+*   Description: readiness callback of files that never block, regular files, directories and the
+*                special files
+*   inputs: fd, poll table
+*   outputs: POLLIN | POLLOUT
+*   effects: none
+*/
+int32_t poll_always(int32_t fd, poll_table_t* pt)
+{
+	return POLLIN | POLLOUT;
+}
+
+/*
+*   Function: poll_check(pollfd_t* fds, int32_t nfds, poll_table_t* pt)
+*   Description: ask every file for its readiness and fill in revents
+*   inputs: the caller's entries, their number, poll table or 0
+*   outputs: number of entries with events
+*   effects: none
+*/
+static int32_t poll_check(pollfd_t* fds, int32_t nfds, poll_table_t* pt)
+{
+	pcb_t* pcb = Find_PCB(current_pid());
+	poll_func_t func;
+	int32_t i, fd, ev, ready = 0;
+
+	for (i = 0; i < nfds; i++) {
+		fd = fds[i].fd;
+		if (fd < 0 || fd >= MAX_FILE_NUM || pcb->file_array[fd].flags == 0) {
+			ev = POLLNVAL;
+		}
+		else {
+			func = (poll_func_t)pcb->file_array[fd].f_op[4];
+			ev = func(fd, pt) & (fds[i].events | POLLERR | POLLHUP);
+		}
+		fds[i].revents = ev;
+		if (ev != 0)
+			ready++;
+	}
+	return ready;
+}
+
+/*
+*   int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout)
+*   	DESCRIPTION: 	wait until one of the files is ready for the events asked for, sleeping on the
+*   					wait queues of all of them at once
+*   	INPUT: 			entries, their number, timeout in ms, 0 to only check, negative for none
+*		OUTPUT: 		number of entries with revents set, 0 on timeout, -1 for bad arguments or
+*   					when a signal came first
+*/
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout)
+{
+	int32_t cur = current_pid();
+	poll_table_t pt;
+	uint64_t deadline = 0;
+	uint32_t flags, me = 1 << cur;
+	int32_t i, ready, done;
+
+	if (nfds < 0 || nfds > POLL_MAX_FDS)
+		return -1;
+	if (nfds > 0 && check_user_range(fds, nfds * sizeof(pollfd_t), 1) == -1)
+		return -1;
+	if (timeout > 0)
+		deadline = clock_ns() + (uint64_t)timeout * NS_PER_MS;
+
+	while (1) {
+		pt.n = 0;
+		ready = poll_check(fds, nfds, (timeout != 0) ? &pt : NULL);
+		spin_lock_irqsave(&sched_lock, flags);
+		done = ready != 0 || timeout == 0 || (timeout > 0 && clock_ns() >= deadline);
+		if (!done && signal_pending_locked()) {
+			done = 1;
+			ready = -1;
+		}
+		if (!done) {
+			for (i = 0; i < pt.n && (pt.wq[i]->waiters & me); i++);
+			if (i == pt.n && timeout > 0) {
+				sleep_timeout_locked(deadline);
+			}
+			else if (i == pt.n) {
+				Find_PCB(cur)->state = TASK_BLOCKED;
+				schedule_locked();
+			}
+		}
+		for (i = 0; i < pt.n; i++)
+			pt.wq[i]->waiters &= ~me;
+		spin_unlock_irqrestore(&sched_lock, flags);
+		if (done)
+			return ready;
+	}
+}
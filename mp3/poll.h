@@ -0,0 +1,41 @@
+#ifndef _POLL_H
+#define _POLL_H
+
+#include "types.h"
+#include "wait_queue.h"
+
+/* events, the POSIX values */
+#define POLLIN			0x01		// read would not block
+#define POLLOUT			0x04		// write would not block
+#define POLLERR			0x08		// the other end of a pipe is gone for a writer
+#define POLLHUP			0x10		// the other end of a pipe is gone for a reader
+#define POLLNVAL		0x20		// fd is not open
+
+#define POLL_MAX_FDS	8			// entries a single poll takes, as many as a process has fds
+#define POLL_MAX_WQ		(POLL_MAX_FDS * 2)
+
+typedef struct pollfd_t {
+	int32_t fd;
+	int16_t events;					// asked for, POLLERR, POLLHUP and POLLNVAL are always reported
+	int16_t revents;				// filled in by poll
+} pollfd_t;
+
+/* Wait queues the readiness callbacks of the polled files hand to poll_wait,
+ * the caller sleeps on all of them at once. */
+typedef struct poll_table_t {
+	wait_queue_t* wq[POLL_MAX_WQ];
+	int32_t n;
+} poll_table_t;
+
+/* Readiness callback of a file, entry 4 of its f_op after read, write, open
+ * and close. Returns the events that are ready now and passes every wait
+ * queue a change would be signalled on to poll_wait. */
+typedef int32_t (*poll_func_t)(int32_t fd, poll_table_t* pt);
+
+void poll_wait(poll_table_t* pt, wait_queue_t* wq);
+int32_t poll_always(int32_t fd, poll_table_t* pt);
+
+/* system call */
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout);
+
+#endif
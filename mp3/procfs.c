@@ -0,0 +1,157 @@
+#include "procfs.h"
+#include "lib.h"
+#include "syscall.h"
+#include "mutex.h"
+#include "irq_stat.h"
+#include "prof.h"
+#include "trace.h"
+#include "serial.h"
+
+/* A special file is a name and a generator that prints its whole text with
+ * proc_puts/proc_putu. The text is rebuilt on every read and f_position picks
+ * the part to copy out, so `cat stat` always shows current numbers. A file
+ * with a control function also takes writes, a file with a read function
+ * streams its own data instead of text. */
+typedef struct proc_file_t {
+	const int8_t* name;
+	void (*show)(void);
+	int32_t (*control)(const uint8_t* buf, int32_t nbytes);
+	int32_t (*read)(uint8_t* buf, int32_t nbytes);
+} proc_file_t;
+
+static proc_file_t proc_files[] = {
+	{ "stat", sched_stat_show, 0, 0 },
+	{ "locks", lock_stat_show, 0, 0 },
+	{ "irqs", irq_stat_show, irq_stat_control, 0 },
+	{ "profile", prof_show, prof_control, 0 },
+	{ "trace", 0, trace_control, trace_read },
+	{ "tracestat", trace_show, 0, 0 },
+};
+
+#define PROC_FILE_NUM	(sizeof(proc_files) / sizeof(proc_file_t))
+
+static int8_t proc_buf[PROC_BUF_SIZE];
+static int32_t proc_len;
+static mutex_t proc_lock = MUTEX_INIT("proc");		// one reader at a time builds its text in proc_buf
+
+/*
+*   int32_t proc_lookup(const uint8_t* name)
+*   	DESCRIPTION: 	find the special file called name
+*   	INPUT: 			file name
+*		OUTPUT: 		index of the file, -1 if there is none
+*/
+int32_t proc_lookup(const uint8_t* name)
+{
+	int32_t i;
+
+	for (i = 0; i < PROC_FILE_NUM; i++) {
+		if (strncmp(proc_files[i].name, (int8_t*)name, buf_len) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+*   int32_t proc_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+*   	DESCRIPTION: 	generate the text of the file and copy out the part after f_position,
+*   					or let the read function of the file fill the buffer
+*   	INPUT: 			fd, buffer, bytes wanted
+*		OUTPUT: 		bytes read, 0 at end of file
+*/
+int32_t proc_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+{
+	file_t* file = &Find_PCB(current_pid())->file_array[fd];
+	int32_t n;
+
+	mutex_lock(&proc_lock);
+	if (proc_files[file->inode].read != 0) {
+		n = proc_files[file->inode].read(buf, nbytes);
+		mutex_unlock(&proc_lock);
+		return n;
+	}
+	proc_len = 0;
+	proc_files[file->inode].show();
+	n = proc_len - (int32_t)file->f_position;
+	if (n < 0)
+		n = 0;
+	if (n > nbytes)
+		n = nbytes;
+	memcpy(buf, proc_buf + file->f_position, n);
+	mutex_unlock(&proc_lock);
+
+	file->f_position += n;
+	return n;
+}
+
+/*
+*   int32_t proc_write / proc_open / proc_close
+*   	DESCRIPTION: 	a write goes to the control function of the file, the others are
+*   					read-only. Open and close have nothing to do.
+*   	INPUT: 			fd, buffer, bytes
+*		OUTPUT: 		what the control function returns, -1 for a read-only file, 0 otherwise
+*/
+int32_t proc_write(int32_t fd, const uint8_t* buf, int32_t nbytes)
+{
+	file_t* file = &Find_PCB(current_pid())->file_array[fd];
+
+	if (proc_files[file->inode].control == 0)
+		return -1;
+	return proc_files[file->inode].control(buf, nbytes);
+}
+
+int32_t proc_open(void)
+{
+	return 0;
+}
+
+int32_t proc_close(int32_t fd)
+{
+	return 0;
+}
+
+/*
+*   void proc_serial(void (*show)(void))
+*   	DESCRIPTION: 	generate the text of a file and send it over the serial port instead of
+*   					to a reader, for the control functions
+*   	INPUT: 			generator
+*		OUTPUT: 		none
+*/
+void proc_serial(void (*show)(void))
+{
+	mutex_lock(&proc_lock);
+	proc_len = 0;
+	show();
+	serial_send((uint8_t*)proc_buf, proc_len);
+	mutex_unlock(&proc_lock);
+}
+
+/*
+*   void proc_puts(const int8_t* s)
+*   	DESCRIPTION: 	append a string to the text being generated
+*   	INPUT: 			string
+*		OUTPUT: 		none
+*/
+void proc_puts(const int8_t* s)
+{
+	while (*s != '\0' && proc_len < PROC_BUF_SIZE) {
+		proc_buf[proc_len] = *s;
+		proc_len++;
+		s++;
+	}
+}
+
+/*
+*   void proc_putu(uint32_t value, int32_t width)
+*   	DESCRIPTION: 	append a decimal number, right aligned in width columns
+*   	INPUT: 			number, width
+*		OUTPUT: 		none
+*/
+void proc_putu(uint32_t value, int32_t width)
+{
+	int8_t conv_buf[36];
+
+	itoa(value, conv_buf, 10);
+	for (width -= strlen(conv_buf); width > 0; width--)
+		proc_puts(" ");
+	proc_puts(conv_buf);
+}
@@ -0,0 +1,22 @@
+#ifndef _PROCFS_H
+#define _PROCFS_H
+
+#include "types.h"
+
+#define PROC_BUF_SIZE	0x2000		// largest text a special file can produce
+
+/* kernel generated read-only files, opened by name before the file system is searched */
+int32_t proc_lookup(const uint8_t* name);
+
+/* special file operations */
+int32_t proc_read(int32_t fd, uint8_t* buf, int32_t nbytes);
+int32_t proc_write(int32_t fd, const uint8_t* buf, int32_t nbytes);
+int32_t proc_open(void);
+int32_t proc_close(int32_t fd);
+
+/* used by the generators to build the text of a file */
+void proc_puts(const int8_t* s);
+void proc_putu(uint32_t value, int32_t width);
+void proc_serial(void (*show)(void));
+
+#endif
@@ -0,0 +1,106 @@
+#include "prof.h"
+#include "lib.h"
+#include "procfs.h"
+#include "scheduling.h"
+
+/* Statistical profiler. Every timer interrupt on every cpu counts the
+ * interrupted eip in a histogram of the kernel text, or one user sample.
+ * prof.py on the host turns the "profile" special file into symbols. */
+static uint32_t prof_hist[PROF_BUCKETS];
+static volatile uint32_t prof_on;
+static uint32_t prof_total;
+static uint32_t prof_user;
+static uint32_t prof_other;		// kernel samples outside the text, or past PROF_TEXT_MAX
+static uint32_t prof_tickless;	// mode to go back to when profiling stops
+
+extern uint8_t etext;			// end of the kernel text, from the linker
+
+/*
+*   Function: prof_sample(uint32_t eip, uint32_t cs)
+*   Description: count one sample while profiling, called by the timer interrupt
+*   inputs: eip and cs of the interrupted code
+*   outputs: none
+*   effects: interrupts off, any cpu
+*/
+void prof_sample(uint32_t eip, uint32_t cs)
+{
+	uint32_t* count;
+
+	if (!prof_on)
+		return;
+	if (cs & 0x3)
+		count = &prof_user;
+	else if (eip >= PROF_TEXT_START && eip < (uint32_t)&etext && eip - PROF_TEXT_START < PROF_TEXT_MAX)
+		count = &prof_hist[(eip - PROF_TEXT_START) >> PROF_SHIFT];
+	else
+		count = &prof_other;
+	asm volatile("lock; incl %0" : "+m"(*count));
+	asm volatile("lock; incl %0" : "+m"(prof_total));
+}
+
+/*
+*   Function: prof_control(const uint8_t* buf, int32_t nbytes)
+*   Description: write to the "profile" special file. "start" clears the histogram and samples on
+*                a periodic tick, tickless mode would leave out the idle and lone processes.
+*                "stop" ends sampling and restores the tick mode.
+*   inputs: command, its length
+*   outputs: nbytes, -1 for an unknown command
+*   effects:
+*/
+int32_t prof_control(const uint8_t* buf, int32_t nbytes)
+{
+	uint32_t i;
+
+	if (nbytes >= 5 && strncmp((int8_t*)buf, "start", 5) == 0) {
+		if (prof_on)
+			return nbytes;
+		prof_on = 0;
+		for (i = 0; i < PROF_BUCKETS; i++)
+			prof_hist[i] = 0;
+		prof_total = 0;
+		prof_user = 0;
+		prof_other = 0;
+		prof_tickless = tickless;
+		sched_set_tickless(0);
+		prof_on = 1;
+		return nbytes;
+	}
+	if (nbytes >= 4 && strncmp((int8_t*)buf, "stop", 4) == 0) {
+		if (prof_on) {
+			prof_on = 0;
+			sched_set_tickless(prof_tickless);
+		}
+		return nbytes;
+	}
+	return -1;
+}
+
+/*
+*   Function: prof_show()
+*   Description: print the profile for the "profile" special file: the sample totals, then one
+*                "address count" line, in hex and decimal, per bucket that was hit
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void prof_show(void)
+{
+	int8_t conv_buf[36];
+	uint32_t i;
+
+	proc_puts("samples");
+	proc_putu(prof_total, 10);
+	proc_puts(" user");
+	proc_putu(prof_user, 10);
+	proc_puts(" other");
+	proc_putu(prof_other, 10);
+	proc_puts("\n");
+	for (i = 0; i < PROF_BUCKETS; i++) {
+		if (prof_hist[i] == 0)
+			continue;
+		proc_puts("0x");
+		proc_puts(itoa(PROF_TEXT_START + (i << PROF_SHIFT), conv_buf, 16));
+		proc_putu(prof_hist[i], 10);
+		proc_puts("\n");
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef _PROF_H
+#define _PROF_H
+
+#include "types.h"
+
+#define PROF_TEXT_START		0x400000	// kernel is linked here
+#define PROF_TEXT_MAX		0x40000		// kernel text the histogram can cover
+#define PROF_SHIFT			4			// 16 bytes of code per bucket
+#define PROF_BUCKETS		(PROF_TEXT_MAX >> PROF_SHIFT)
+
+void prof_sample(uint32_t eip, uint32_t cs);
+void prof_show(void);
+int32_t prof_control(const uint8_t* buf, int32_t nbytes);
+
+#endif
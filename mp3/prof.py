@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Symbolize a kernel profile.
+#
+# In the kernel:  echo start > profile, run the workload, echo stop > profile,
+#                 then save `cat profile` (or capture it from serial).
+# On the host:    ./prof.py bootimg profile.txt
+#
+# Every histogram bucket is charged to the function it starts in, using the
+# symbol table of bootimg from nm. Functions are printed by sample count.
+
+import bisect
+import subprocess
+import sys
+
+
+def load_symbols(image):
+    out = subprocess.run(["nm", "-n", image], check=True, capture_output=True, text=True).stdout
+    addrs, names = [], []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            addrs.append(int(parts[0], 16))
+            names.append(parts[2])
+    return addrs, names
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: prof.py bootimg profile.txt")
+    addrs, names = load_symbols(sys.argv[1])
+
+    counts = {}
+    total = user = other = 0
+    with open(sys.argv[2]) as f:
+        for line in f:
+            parts = line.split()
+            if not parts:
+                continue
+            if parts[0] == "samples":
+                total, user, other = int(parts[1]), int(parts[3]), int(parts[5])
+                continue
+            addr, n = int(parts[0], 16), int(parts[1])
+            i = bisect.bisect_right(addrs, addr) - 1
+            name = names[i] if i >= 0 else "?"
+            counts[name] = counts.get(name, 0) + n
+
+    total = max(total, 1)
+    print("%d samples, %.1f%% user, %.1f%% unknown" % (total, 100.0 * user / total, 100.0 * other / total))
+    for name, n in sorted(counts.items(), key=lambda kv: -kv[1]):
+        print("%8d %6.2f%%  %s" % (n, 100.0 * n / total, name))
+
+
+if __name__ == "__main__":
+    main()
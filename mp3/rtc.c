@@ -1,12 +1,44 @@
 #include "i8259.h"
 #include "lib.h"
 #include "rtc.h"
+#include "syscall.h"
 
-//Set all the nesessary bits in control register A and B and write to CMOS port
+wait_queue_t rtc_wq;		// readers waiting for the next tick of their file
+spinlock_t rtc_lock = SPINLOCK_INIT("rtc");
+static uint32_t rtc_files[MAX_PROCESS];		// open RTC fds of every pid, one bit per fd
+static int32_t rtc_open_num;				// open RTC fds in all processes, IRQ8 is masked at 0
+
+/* rtc_irq_get / rtc_irq_put:
+ * 		DESCRIPTION:  count an RTC fd opened or closed. The first one unmasks IRQ8, after reading
+ *                    register C so a flag left from the last interrupt does not hold the line;
+ *                    the last one masks it again, so an idle system takes no RTC interrupts.
+ *      INPUT:        none
+ *      OUTPUT:       none
+ *      SIDE EFFECTS: rtc_lock held
+ */
+static void rtc_irq_get(void)
+{
+	if (rtc_open_num++ != 0)
+		return;
+	outb(Control_C, RTC_port);
+	inb(CMOS_port);
+	enable_irq(RTC_IRQ);
+}
+
+static void rtc_irq_put(void)
+{
+	if (--rtc_open_num == 0)
+		disable_irq(RTC_IRQ);
+}
+
+//Set all the nesessary bits in control register A and B and write to CMOS port.
+//IRQ8 stays masked until the first rtc_open
 //Input: none
 //Output: none
 void rtc_init(void)
 {
+	uint32_t flags;
+	spin_lock_irqsave(&rtc_lock, flags);
 	outb(Control_A, RTC_port);                  //tell RTC which register we are dealing with
 	unsigned char a = inb(CMOS_port);
 
@@ -14,92 +46,141 @@ void rtc_init(void)
 	unsigned char b = inb(CMOS_port);
 
 	outb(Control_A, RTC_port);
-	outb((UIP_mask & a) | DV_RS, CMOS_port); // set frequence to 2Hz and turn on the oscillator
+	outb((UIP_mask & a) | DV_RS, CMOS_port); // set frequence to 1024Hz and turn on the oscillator
 
 	outb(Control_B, RTC_port);
 	outb((b | Control_B_mask), CMOS_port);  // set DSE, 24 hours, Binary data, Square wave and Periodic interrupt 
-	enable_irq(RTC_IRQ);
+	spin_unlock_irqrestore(&rtc_lock, flags);
 }
 /* rtc_open:
- * 		DESCRIPTION:  enable irq
- *      INPUT:        none
+ * 		DESCRIPTION:  start the file at RTC_DEFAULT_FREQ and count it down from the next interrupt
+ *      INPUT:        fd
  *      OUTPUT:       0
  */
 int rtc_open(int32_t fd, int8_t* buf, int32_t nbytes)
 {
-	rtc_init();
+	int32_t cur = current_pid();
+	file_t* file = &Find_PCB(cur)->file_array[fd];
+	uint32_t flags;
+
+	spin_lock_irqsave(&rtc_lock, flags);
+	file->rtc_div = RTC_HW_FREQ / RTC_DEFAULT_FREQ;
+	file->rtc_count = file->rtc_div;
+	file->rtc_ticks = 0;
+	file->rtc_seen = 0;
+	rtc_files[cur] |= 1 << fd;
+	rtc_irq_get();
+	spin_unlock_irqrestore(&rtc_lock, flags);
 	return 0;
 }
+/* rtc_dup:
+ * 		DESCRIPTION:  a forked child got a copy of an open file, count it down as well
+ *      INPUT:        pid of the child, fd
+ *      OUTPUT:       none
+ */
+void rtc_dup(int32_t p, int32_t fd)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&rtc_lock, flags);
+	rtc_files[p] |= 1 << fd;
+	rtc_irq_get();
+	spin_unlock_irqrestore(&rtc_lock, flags);
+}
 /* rtc_close:
- * 		DESCRIPTION:  disable interrupt
- *      INPUT:        none
+ * 		DESCRIPTION:  stop counting the file down, the last one to close masks the interrupt
+ *      INPUT:        fd
  *      OUTPUT:       0
  */
 int rtc_close(int32_t fd, int8_t* buf, int32_t nbytes)
 {
-	disable_irq(RTC_IRQ);
+	uint32_t flags;
+
+	spin_lock_irqsave(&rtc_lock, flags);
+	rtc_files[current_pid()] &= ~(1 << fd);
+	rtc_irq_put();
+	spin_unlock_irqrestore(&rtc_lock, flags);
 	return 0;
 }
 /* rtc_read:
- * 		DESCRIPTION:  block until interrupt
- *      INPUT:        none
- *      OUTPUT:       0
+ * 		DESCRIPTION:  sleep until this file ticked since the last read, right away if it did in
+ *                    between, so a read after poll reported POLLIN does not block
+ *      INPUT:        fd
+ *      OUTPUT:       0, -1 when a signal came first
  */
 int rtc_read(int32_t fd, int8_t* buf, int32_t nbytes)
 {
-	while (rtc_flag);
-	rtc_flag = 1;
+	file_t* file = &Find_PCB(current_pid())->file_array[fd];
+	int32_t ret;
+
+	wait_event_interruptible(&rtc_wq, file->rtc_ticks != file->rtc_seen, ret);
+	if (ret == -1)
+		return -1;
+	file->rtc_seen = file->rtc_ticks;
 	return 0;
 }
+/* rtc_poll:
+ * 		DESCRIPTION:  readiness of the file for poll
+ *      INPUT:        fd, poll table
+ *      OUTPUT:       POLLIN if it ticked since the last read, POLLOUT always
+ */
+int rtc_poll(int32_t fd, poll_table_t* pt)
+{
+	file_t* file = &Find_PCB(current_pid())->file_array[fd];
+
+	poll_wait(pt, &rtc_wq);
+	return ((file->rtc_ticks != file->rtc_seen) ? POLLIN : 0) | POLLOUT;
+}
 /* rtc_write:
- * 		DESCRIPTION:  change the clock rate
- *      INPUT:        none
- *      OUTPUT:       0
+ * 		DESCRIPTION:  change the rate of this file, a power of two from 2 to 1024Hz. The hardware
+ *                    keeps running at RTC_HW_FREQ, other files are not affected.
+ *      INPUT:        fd, pointer to the rate
+ *      OUTPUT:       4, -1 for a bad rate
  */
 int rtc_write(int32_t fd, void* buf, int32_t nbytes)
 {
-	int RS;
-	outb(Control_A, RTC_port);
-	unsigned char a = inb(CMOS_port);  //Get orginal data from RTC
-    int32_t freq =  *((int32_t*)buf);
-	switch (freq) {
-	case 1024:
-		RS = 6;
-		break;
-	case 512:
-		RS = 7;
-		break;
-	case 256:
-		RS = 8;
-		break;
-	case 128:
-		RS = 9;
-		break;
-	case 64:
-		RS = 10;
-		break;
-	case 32:
-		RS = 11;
-		break;
-	case 16:
-		RS = 12;
-		break;
-	case 8:
-		RS = 13;
-		break;
-	case 4:
-		RS = 14;
-		break;
-	case 2:
-		RS = 15;
-		break;
-	default:
+	file_t* file = &Find_PCB(current_pid())->file_array[fd];
+	uint32_t flags;
+	int32_t freq;
+
+	if (buf == NULL)
 		return -1;
-	}
-	outb(Control_A, RTC_port);
-	outb((a & RS_mask) | RS, CMOS_port); // set frequence to RS Hz
+	freq = *((int32_t*)buf);
+	if (freq < 2 || freq > RTC_HW_FREQ || (freq & (freq - 1)) != 0)
+		return -1;
+	spin_lock_irqsave(&rtc_lock, flags);
+	file->rtc_div = RTC_HW_FREQ / freq;
+	file->rtc_count = file->rtc_div;
+	spin_unlock_irqrestore(&rtc_lock, flags);
 	return 4;
 }
+/* rtc_tick:
+ * 		DESCRIPTION:  one hardware interrupt, called by the bottom half. Count down every open file
+ *                    and wake only the processes that read a file whose tick came.
+ *      INPUT:        none
+ *      OUTPUT:       none
+ */
+void rtc_tick(void)
+{
+	uint32_t flags, fds, woken = 0;
+	file_t* file;
+	int32_t p, fd;
 
-
-
+	spin_lock_irqsave(&rtc_lock, flags);
+	for (p = 0; p < MAX_PROCESS; p++) {
+		fds = rtc_files[p];
+		for (fd = 0; fds != 0; fd++, fds >>= 1) {
+			if (!(fds & 1))
+				continue;
+			file = &Find_PCB(p)->file_array[fd];
+			if (--file->rtc_count != 0)
+				continue;
+			file->rtc_count = file->rtc_div;
+			file->rtc_ticks++;
+			woken |= 1 << p;
+		}
+	}
+	spin_unlock_irqrestore(&rtc_lock, flags);
+	if (woken != 0)
+		wake_up_some(&rtc_wq, woken);
+}
@@ -2,8 +2,10 @@
 #define _RTC_H
 
 #include "types.h"
+#include "wait_queue.h"
+#include "poll.h"
 
-#define DV_RS 0x2F
+#define DV_RS 0x26			// oscillator on, 1024Hz
 #define Control_A 0x8A
 #define Control_B 0x8B
 #define RTC_port 0x70
@@ -13,15 +15,21 @@
 #define Control_B_mask 0x4F
 #define Control_C 0x0C
 #define RS_mask 0xF0
+#define RTC_HW_FREQ 1024		// the hardware rate, every open file divides it down to its own
+#define RTC_DEFAULT_FREQ 2		// rate of a newly opened file
 
-int rtc_flag;
+extern wait_queue_t rtc_wq;
+extern spinlock_t rtc_lock;		// the CMOS index and data ports go in pairs, and the open files
 
 // initiliaze rtc
 void rtc_init(void);
+void rtc_tick(void);
+void rtc_dup(int32_t p, int32_t fd);
 int rtc_open(int32_t fd, int8_t* buf, int32_t nbytes);
 int rtc_close(int32_t fd, int8_t* buf, int32_t nbytes);
 int rtc_read(int32_t fd, int8_t* buf, int32_t nbytes);
 int rtc_write(int32_t fd, void* buf, int32_t nbytes);
+int rtc_poll(int32_t fd, poll_table_t* pt);
 
 #endif
 
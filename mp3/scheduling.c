@@ -1,22 +1,58 @@
 #include "scheduling.h"
+#include "scheduling_linkage.h"
+#include "apic.h"
+#include "irq_stat.h"
+#include "trace.h"
+#include "timer.h"
 
+/* Multilevel feedback queues: one FIFO of runnable pids per priority level,
+ * level 0 runs first. The running process is not in any of them. A process
+ * that uses up its slice sinks one level to a longer slice, a process that
+ * wakes from sleep goes back to its nice level, and every BOOST_TICKS all
+ * processes are lifted to their nice level so nothing starves.
+ * Blocked processes are left out and put back by wake_up.
+ * Every cpu has its own set of queues, a cpu whose queues run dry steals
+ * from the busiest one. */
+typedef struct run_queue_t {
+	int32_t queue[NUM_PRIO][MAX_PROCESS];
+	uint32_t head[NUM_PRIO];
+	uint32_t count[NUM_PRIO];
+	uint32_t boost_ticks;
+	uint32_t shot_ticks;	// ticks the armed one-shot covers, 0 when the timer is stopped
+	uint32_t periodic;		// the timer of this cpu ticks periodically
+	uint32_t idle_esp;		// the idle task of the cpu (pid -1) while a process runs
+	uint64_t acct_stamp;	// tsc of the last switch or syscall entry/exit, the cycles since then belong to the running process
+} run_queue_t;
 
-volatile uint8_t curr_term = 0;
-uint8_t next_term = 0;
+static run_queue_t run_queue[MAX_CPU];
+spinlock_t sched_lock = SPINLOCK_INIT("sched");
+static const int32_t slice_ticks[NUM_PRIO] = { 1, 2, 4, 8 };
 
-int terminal_pid[];
-int next_index;
-pcb_t * cur_pcb; // current pcb
-int init_flag;
-int cur_index;
-uint32_t esp, ebp;
+#define this_rq() (&run_queue[this_cpu()->id])
+#define running() (this_cpu()->cur_pid)		// process this cpu runs, pid is still the old one in schedule
+
+/* idle accounting, PIT ticks that found the idle task running and tsc cycles spent in it */
+uint32_t total_ticks;
+uint32_t idle_ticks;
+uint64_t idle_tsc;
+
+/* tickless mode: the timer runs one-shot and only while another process waits for the cpu */
+uint32_t tickless = 1;
+static uint32_t lapic_tick;		// local APIC timer count of one tick, measured once against the PIT
+
+static int32_t runnable();
+static int32_t ready_above(int32_t prio);
+static int32_t sched_pending();
+static void sched_tick_locked(uint32_t n);
+static void finish_switch();
 
 /*
 *   Function: PIT_init()
-*   Description: initializes PIT
+*   Description: start the scheduler tick of this cpu. In APIC mode that is the local APIC timer
+*                on the vector of the PIT, which stays masked.
 *   inputs: none
 *   outputs: none
-*   effects: 
+*   effects: the first call in APIC mode measures the local APIC timer
 *   background:
 *       http://wiki.osdev.org/Programmable_Interval_Timer
 *       http://www.osdever.net/bkerndev/Docs/pit.htm
@@ -24,6 +60,16 @@ uint32_t esp, ebp;
 void PIT_init(void) 
 {
 	int divisor = dividor_num;   // 1193180/100 , 100 is for accurate and easy timekeeping
+	this_rq()->shot_ticks = 0;
+	this_rq()->periodic = !tickless;
+	if (apic_mode && lapic_tick == 0)
+		lapic_tick = lapic_timer_calibrate(dividor_num);
+	if (tickless)		// armed by timer_arm once there is something to preempt
+		return;
+	if (apic_mode) {
+		lapic_timer_start(lapic_tick, 1);
+		return;
+	}
 	outb(PIT_SQUARE_WAVE_MODE, PIT_COMMAND_REG);  // set our command byte 0x36
 	outb(divisor & DIVISOR_MASK,PIT_CHANNEL_0);    // set low byte of divisor
 	outb(divisor >> 8,PIT_CHANNEL_0);  // set high byte of fivisor
@@ -31,146 +77,830 @@ void PIT_init(void)
 	return;
 }
 
+/*
+*   Function: tick_charge(uint32_t n)
+*   Description: account n timer ticks to the tick counters and to the running time slice
+*   inputs: number of ticks
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void tick_charge(uint32_t n)
+{
+	total_ticks += n;
+	this_rq()->boost_ticks += n;
+	if (running() == -1)
+		idle_ticks += n;
+	else
+		Find_PCB(running())->ticks -= n;
+}
+
+/*
+*   Function: oneshot_start(uint32_t n)
+*   Description: fire the timer once, n ticks from now
+*   inputs: number of ticks, at most ONESHOT_MAX_TICKS
+*   outputs: none
+*   effects:
+*/
+static void oneshot_start(uint32_t n)
+{
+	uint32_t count;
+
+	if (apic_mode) {
+		lapic_timer_start(n * lapic_tick, 0);
+		return;
+	}
+	count = n * dividor_num;
+	outb(PIT_ONESHOT_MODE, PIT_COMMAND_REG);
+	outb(count & DIVISOR_MASK, PIT_CHANNEL_0);
+	outb(count >> 8, PIT_CHANNEL_0);
+}
+
+/*
+*   Function: oneshot_stop(uint32_t n)
+*   Description: stop a one-shot armed for n ticks
+*   inputs: number of ticks it was armed for
+*   outputs: whole ticks that were left, rounded up
+*   effects:
+*/
+static uint32_t oneshot_stop(uint32_t n)
+{
+	uint32_t left;
+
+	if (apic_mode) {
+		left = lapic_timer_stop();		// stays at 0 once it fired
+		return (left + lapic_tick - 1) / lapic_tick;
+	}
+	outb(PIT_LATCH_COMMAND, PIT_COMMAND_REG);	// latch the count of channel 0
+	left = inb(PIT_CHANNEL_0);
+	left |= inb(PIT_CHANNEL_0) << 8;
+	outb(PIT_ONESHOT_MODE, PIT_COMMAND_REG);	// stops the count until a new one is loaded
+
+	// the counter wraps around once it fires, that shot is complete
+	return (left > n * dividor_num) ? 0 : (left + dividor_num - 1) / dividor_num;
+}
+
+/*
+*   Function: timer_charge()
+*   Description: stop the one-shot and charge the whole ticks that passed since it was armed
+*   inputs: none
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void timer_charge()
+{
+	run_queue_t* rq = this_rq();
+
+	if (rq->shot_ticks == 0)
+		return;
+	tick_charge(rq->shot_ticks - oneshot_stop(rq->shot_ticks));
+	rq->shot_ticks = 0;
+}
+
+/*
+*   Function: timer_arm()
+*   Description: in tickless mode, program the timer of this cpu to fire when the running slice
+*                ends. Nothing is armed for the idle task or a process that has the cpu to itself,
+*                unless this is TIMER_CPU and the timer wheel is due earlier. A waiting process of
+*                higher priority gets the next tick.
+*   inputs: none
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void timer_arm()
+{
+	pcb_t* cur;
+	uint32_t n = 0, due;
+
+	if (!tickless || this_rq()->shot_ticks != 0)
+		return;
+	if (running() != -1 && runnable()) {
+		cur = Find_PCB(running());
+		n = (ready_above(cur->prio) || cur->ticks < 1) ? 1 : cur->ticks;
+		if (n > ONESHOT_MAX_TICKS)
+			n = ONESHOT_MAX_TICKS;
+	}
+	if (this_cpu()->id == TIMER_CPU) {
+		due = timer_next_locked(ONESHOT_MAX_TICKS);
+		if (due != 0 && (n == 0 || due < n))
+			n = due;
+	}
+	if (n == 0)
+		return;
+
+	oneshot_start(n);
+	this_rq()->shot_ticks = n;
+}
+
+/*
+*   Function: timer_sync()
+*   Description: bring the timer of this cpu in line with tickless after sched_set_tickless changed
+*                it. The periodic tick is started, or stopped and the timer left to timer_arm.
+*   inputs: none
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void timer_sync()
+{
+	run_queue_t* rq = this_rq();
+
+	if (rq->periodic == !tickless || (!apic_mode && this_cpu()->id != 0))	// the PIT belongs to the boot cpu
+		return;
+	timer_charge();
+	if (tickless) {
+		rq->periodic = 0;
+		if (apic_mode)
+			lapic_timer_stop();
+		else
+			outb(PIT_ONESHOT_MODE, PIT_COMMAND_REG);	// stops the count until a new one is loaded
+		timer_arm();
+	}
+	else {
+		PIT_init();
+	}
+}
+
+/*
+*   Function: sched_set_tickless(uint32_t on)
+*   Description: switch between tickless mode and the periodic tick at run time. The other cpus
+*                follow on their next timer interrupt or the IPI sent here.
+*   inputs: 1 for tickless mode
+*   outputs: 0 on success, -1 if the cpus share the periodic PIT tick, which has to stay
+*   effects:
+*/
+int32_t sched_set_tickless(uint32_t on)
+{
+	uint32_t flags;
+
+	if (on && cpu_num > 1 && !apic_mode)
+		return -1;
+	spin_lock_irqsave(&sched_lock, flags);
+	tickless = on;
+	timer_sync();
+	spin_unlock_irqrestore(&sched_lock, flags);
+	if (cpu_num > 1)
+		lapic_ipi_others(ICR_FIXED | IPI_RESCHED);
+	return 0;
+}
+
 /*
 *   Function: sche_init()
-*   Description: initializes scheduling pid for each terminal, initializes flags for terminal checking
+*   Description: empty the run queue and map the video pages of every terminal
 *   inputs: none
 *   outputs: none
 *   effects: 
 */
 void sche_init()
 {
-	int i;
-	// initializes terminal pid
-	for (i = 0; i < 3; i++) {
-		terminal_pid[i] = -1;
+	int i, j;
+
+	for (i = 0; i < MAX_CPU; i++) {
+		for (j = 0; j < NUM_PRIO; j++) {
+			run_queue[i].head[j] = 0;
+			run_queue[i].count[j] = 0;
+		}
+		run_queue[i].boost_ticks = 0;
+		run_queue[i].shot_ticks = 0;
+	}
+	total_ticks = 0;
+	idle_ticks = 0;
+	idle_tsc = 0;
+	// set up new video memory pages for every terminal
+	for (i = 0; i < TERMINAL_NUM; i++) {
+		vid_new(VIDEO_MEM + 2 * SCREEN_SIZE * i, i);
+	}
+}
+
+/*
+*   Function: sche_start()
+*   Description: move the boot context off the boot stack, which is the kernel stack of pid 0,
+*                and turn it into the idle task of the boot cpu
+*   inputs: none
+*   outputs: none
+*   effects: never returns
+*/
+void sche_start()
+{
+	cli();
+	asm volatile("movl %0, %%esp	\n\
+				  call sche_boot"
+				:
+				: "r"(cpu_stack[0] + CPU_STACK_SIZE)
+				: "memory"
+				);
+}
+
+/*
+*   Function: sche_boot()
+*   Description: start a shell on every terminal and the other cpus, then idle
+*   inputs: none
+*   outputs: none
+*   effects: never returns
+*/
+void sche_boot()
+{
+	int i, p;
+
+	for (i = 0; i < TERMINAL_NUM; i++) {
+		p = process_create((uint8_t *) "shell", i, -1);
+		if (p != -1)
+			enqueue_process(p);
+	}
+	smp_boot_aps();
+	idle_loop();
+}
+
+/*
+*   Function: idle_loop()
+*   Description: halt the cpu until the next interrupt whenever nothing can run
+*   inputs: none
+*   outputs: none
+*   effects: entered with interrupts off, never returns
+*/
+void idle_loop()
+{
+	rdtsc(this_rq()->acct_stamp);
+
+	// idle task, runs only while every queue is empty. sti takes effect after hlt,
+	// so an interrupt that makes a process runnable cannot slip in before we halt.
+	// The queues are peeked at without the lock, a process queued by another cpu
+	// right after the test comes with an IPI that ends the hlt.
+	while (1) {
+		if (!sched_pending())
+			asm volatile("sti; hlt; cli" : : : "memory");
+		schedule();
+	}
+}
+
+/*
+*   Function: queue_add(int32_t p)
+*   Description: append a runnable process to the tail of the queue of its priority level
+*   inputs: pid
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void queue_add(int32_t p)
+{
+	run_queue_t* rq = &run_queue[Find_PCB(p)->cpu];
+	int32_t prio = Find_PCB(p)->prio;
+
+	rq->queue[prio][(rq->head[prio] + rq->count[prio]) % MAX_PROCESS] = p;
+	rq->count[prio]++;
+}
+
+/*
+*   Function: enqueue_locked(int32_t p)
+*   Description: make a new or woken process wait for the cpu it last ran on. On this cpu the
+*                running process now has company, so in tickless mode the timer is armed again.
+*                Otherwise an idle cpu is kicked to run or steal it, or the busy target cpu to
+*                preempt or arm its own timer.
+*   inputs: pid
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void enqueue_locked(int32_t p)
+{
+	int32_t i, target, idle;
+
+	queue_add(p);
+	target = Find_PCB(p)->cpu;
+	if (target == this_cpu()->id) {
+		timer_charge();
+		timer_arm();
+	}
+	if (cpu_num > 1) {
+		if (target == this_cpu()->id || cpus[target].cur_pid != -1) {
+			idle = -1;
+			for (i = 0; i < cpu_num; i++) {
+				if (cpus[i].cur_pid == -1 && i != this_cpu()->id)
+					idle = i;
+			}
+			if (idle != -1 || target == this_cpu()->id)
+				target = idle;
+		}
+		if (target != -1)
+			smp_kick(target);
+	}
+}
+
+/*
+*   Function: enqueue_process(int32_t p)
+*   Description: queue a new process, see enqueue_locked
+*   inputs: pid
+*   outputs: none
+*   effects: 
+*/
+void enqueue_process(int32_t p)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	enqueue_locked(p);
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: wake_process(int32_t p)
+*   Description: make a sleeping process runnable. It gave up the cpu before its slice ran out,
+*                so it goes back to its nice level and beats the cpu bound processes.
+*   inputs: pid
+*   outputs: none
+*   effects: sched_lock held
+*/
+void wake_process(int32_t p)
+{
+	pcb_t* pcb = Find_PCB(p);
+
+	pcb->state = TASK_RUNNING;
+	pcb->prio = pcb->nice;
+	enqueue_locked(p);
+}
+
+/*
+*   Function: dequeue_process(run_queue_t* rq)
+*   Description: take the process at the head of the highest non empty level
+*   inputs: run queue of a cpu
+*   outputs: pid, -1 if every queue is empty
+*   effects: sched_lock held
+*/
+static int32_t dequeue_process(run_queue_t* rq)
+{
+	int32_t p, prio;
+
+	for (prio = 0; prio < NUM_PRIO; prio++) {
+		if (rq->count[prio] == 0)
+			continue;
+		p = rq->queue[prio][rq->head[prio]];
+		rq->head[prio] = (rq->head[prio] + 1) % MAX_PROCESS;
+		rq->count[prio]--;
+		return p;
 	}
-	// initializes checking flags
-	cur_index = -1;
-	next_index = 0;
-	init_flag = 1;
+	return -1;
+}
+
+/*
+*   Function: queue_length(run_queue_t* rq)
+*   Description: number of processes waiting in the queues of a cpu
+*   inputs: run queue of a cpu
+*   outputs: number of processes
+*   effects: 
+*/
+static int32_t queue_length(run_queue_t* rq)
+{
+	int32_t i, n = 0;
+
+	for (i = 0; i < NUM_PRIO; i++)
+		n += rq->count[i];
+	return n;
+}
+
+/*
+*   Function: steal_process()
+*   Description: take a waiting process from the cpu with the longest queues and move it here
+*   inputs: none
+*   outputs: pid, -1 if no cpu has anything waiting
+*   effects: sched_lock held
+*/
+static int32_t steal_process()
+{
+	int32_t i, busiest = -1, len, max = 0;
+	int32_t p;
+
+	for (i = 0; i < cpu_num; i++) {
+		len = queue_length(&run_queue[i]);
+		if (i != this_cpu()->id && len > max) {
+			max = len;
+			busiest = i;
+		}
+	}
+	if (busiest == -1)
+		return -1;
+	p = dequeue_process(&run_queue[busiest]);
+	Find_PCB(p)->cpu = this_cpu()->id;
+	return p;
+}
+
+/*
+*   Function: ready_above(int32_t prio)
+*   Description: check for a runnable process with a higher priority than prio
+*   inputs: priority level
+*   outputs: 1 if there is one, 0 otherwise
+*   effects: 
+*/
+static int32_t ready_above(int32_t prio)
+{
+	run_queue_t* rq = this_rq();
+	int32_t i;
+
+	for (i = 0; i < prio; i++) {
+		if (rq->count[i] != 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+*   Function: runnable()
+*   Description: check for any process waiting in the run queues
+*   inputs: none
+*   outputs: 1 if there is one, 0 otherwise
+*   effects: 
+*/
+static int32_t runnable()
+{
+	return ready_above(NUM_PRIO);
+}
+
+/*
+*   Function: sched_pending()
+*   Description: check for a process this cpu can run, its own or one to steal
+*   inputs: none
+*   outputs: 1 if there is one, 0 otherwise
+*   effects: 
+*/
+static int32_t sched_pending()
+{
+	int32_t i;
+
+	for (i = 0; i < cpu_num; i++) {
+		if (queue_length(&run_queue[i]) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+*   Function: priority_boost()
+*   Description: lift every runnable process of this cpu back to its nice level
+*   inputs: none
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void priority_boost()
+{
+	int32_t waiting[MAX_PROCESS];
+	int32_t i, n, p;
+
+	n = 0;
+	while ((p = dequeue_process(this_rq())) != -1) {
+		waiting[n] = p;
+		n++;
+	}
+	for (i = 0; i < n; i++) {
+		Find_PCB(waiting[i])->prio = Find_PCB(waiting[i])->nice;
+		queue_add(waiting[i]);
+	}
+	if (running() != -1)
+		Find_PCB(running())->prio = Find_PCB(running())->nice;
 }
 
 /*
 *   Function: scheduling(void)
-*   Description: scheduling process
+*   Description: timer interrupt, one tick or the end of a one-shot. The PIT interrupts the boot
+*                cpu only, its periodic ticks are passed on to the other cpus. In APIC mode every
+*                cpu gets its own from the local APIC timer. TIMER_CPU runs the timer wheel first,
+*                so a process it wakes can take the cpu on this tick.
 *   inputs: none
 *   outputs: none
 *   effects: 
 */
 void scheduling(void)
 {
-	// circulating active terminal index
-	next_index = (cur_index + 1) % 3;
+	uint32_t n = 1;
 
-	// set up new video memory pages for every active terminal index
-	vid_new(VIDEO_MEM + 2 * SCREEN_SIZE * next_index, next_index);
+	send_eoi(0);
+	if (!apic_mode && !tickless && cpu_num > 1)
+		lapic_ipi_others(ICR_FIXED | IPI_TICK);
+	spin_lock(&sched_lock);
+	if (tickless) {
+		n = this_rq()->shot_ticks;
+		this_rq()->shot_ticks = 0;
+	}
+	if (this_cpu()->id == TIMER_CPU)
+		timer_run_locked();
+	sched_tick_locked(n);
+	spin_unlock(&sched_lock);
+}
 
-	//moves esp and ebp 
-	move_registers_out();
+/*
+*   Function: sched_tick(uint32_t n) / sched_tick_locked(uint32_t n)
+*   Description: n timer ticks passed on this cpu. The running process is preempted when its slice
+*                is used up, which also moves it one level down, or when a process of higher
+*                priority is waiting. Not while the cpu runs the bottom halves or the kernel uses
+*                the FPU registers.
+*   inputs: number of ticks
+*   outputs: none
+*   effects: sched_tick runs with interrupts off (IPI handler), sched_tick_locked with sched_lock held
+*/
+void sched_tick(uint32_t n)
+{
+	spin_lock(&sched_lock);
+	sched_tick_locked(n);
+	spin_unlock(&sched_lock);
+}
 
-	// calculate pcb address based on pid
-	calculate_pcbaddr();
+static void sched_tick_locked(uint32_t n)
+{
+	pcb_t* cur;
 
-	//save old esp and ebp
-	cur_pcb->sche_esp = esp;
-	cur_pcb->sche_ebp = ebp;
+	tick_charge(n);
+	timer_sync();
+	if (this_rq()->boost_ticks >= BOOST_TICKS) {
+		this_rq()->boost_ticks = 0;
+		priority_boost();
+	}
+	if (this_cpu()->bh_active || this_cpu()->fpu_kernel) {	// preempted on the next tick instead
+		timer_arm();
+		return;
+	}
+	if (running() != -1) {
+		cur = Find_PCB(running());
+		if (cur->ticks > 0 && !ready_above(cur->prio)) {
+			timer_arm();
+			return;
+		}
+		if (cur->ticks <= 0 && cur->prio < NUM_PRIO - 1)
+			cur->prio++;
+	}
+	schedule_locked();
+}
 
-	terminal_set();
+/*
+*   Function: sched_resched()
+*   Description: another cpu queued a process here, preempt the running one if it has a lower priority,
+*                or arm the timer now that it has company. The idle task picks it up when it comes
+*                out of hlt.
+*   inputs: none
+*   outputs: none
+*   effects: interrupts off (IPI handler)
+*/
+void sched_resched()
+{
+	spin_lock(&sched_lock);
+	timer_sync();
+	if (running() != -1 && !this_cpu()->bh_active && !this_cpu()->fpu_kernel && ready_above(Find_PCB(running())->prio)) {
+		schedule_locked();
+	}
+	else {
+		timer_charge();
+		timer_arm();
+	}
+	spin_unlock(&sched_lock);
+}
 
-	//change ss0, esp0 and restore esp, ebp
-	tss.ss0 = KERNEL_DS;
-	tss.esp0 = EIGHT_MB - EIGHT_KB*(cur_pcb->cur_pid) - 4;
-	esp = cur_pcb->sche_esp;
-	ebp = cur_pcb->sche_ebp;
+/*
+*   int32_t nice(int32_t inc)
+*   	DESCRIPTION: 	change the nice value of the calling process. A higher nice value starts the
+*						process on a lower priority level, 0 is the default and the highest.
+*   	INPUT: 			amount added to the nice value
+*		OUTPUT: 		the new nice value, clamped to 0..NUM_PRIO-1
+*/
+int32_t nice(int32_t inc)
+{
+	pcb_t* pcb = Find_PCB(current_pid());
+	uint32_t flags;
+	int32_t n;
 
-	// end of interrupt, move esp and ebp
-	send_eoi(0);
-	move_registers_in();
-	return;
+	spin_lock_irqsave(&sched_lock, flags);		// the tick may boost prio meanwhile
+	n = pcb->nice + inc;
+	if (n < 0)
+		n = 0;
+	if (n > NUM_PRIO - 1)
+		n = NUM_PRIO - 1;
+	pcb->nice = n;
+	if (pcb->prio < n)
+		pcb->prio = n;
+	spin_unlock_irqrestore(&sched_lock, flags);
+	return n;
 }
 
 /*
-*   Function: calculate_pcbaddr()
-*   Description: conditionally calculate pcb address based on pid
+*   Function: account_time()
+*   Description: charge the cycles since the last accounting event to the running process, as kernel
+*                time inside a syscall and as user time otherwise. Interrupts taken in user mode are
+*                counted as user time.
 *   inputs: none
 *   outputs: none
-*   effects: 
+*   effects: interrupts must be off
 */
-void calculate_pcbaddr()
-{	// if there is no running process, calculate base pcb addr
-    if (terminal_pid[next_index] == -1 && pid == -1) {
-		cur_pcb = (pcb_t *)(EIGHT_MB - EIGHT_KB*(next_index + 1));
+static void account_time()
+{
+	run_queue_t* rq = this_rq();
+	pcb_t* cur;
+	uint64_t now;
+
+	rdtsc(now);
+	if (running() == -1) {
+		idle_tsc += now - rq->acct_stamp;
 	}
-	// otherwise, calculate pcb addr based on pid
 	else {
-		cur_pcb = (pcb_t *)(EIGHT_MB - EIGHT_KB*(terminal_pid[cur_index] + 1));
+		cur = Find_PCB(running());
+		if (cur->in_syscall)
+			cur->kernel_tsc += now - rq->acct_stamp;
+		else
+			cur->user_tsc += now - rq->acct_stamp;
 	}
-    return;
+	rq->acct_stamp = now;
+}
+
+/*
+*   Function: account_syscall_enter() / account_syscall_exit()
+*   Description: called by syscall_linkage around every syscall to split user and kernel time
+*                and trace it. Only data of this cpu is touched, so turning interrupts off is enough.
+*   inputs: index of the syscall in the jump table / its return value
+*   outputs: none
+*   effects: 
+*/
+void account_syscall_enter(uint32_t call)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	account_time();
+	Find_PCB(current_pid())->in_syscall = 1;
+	trace(TRACE_SYSCALL_ENTER, call + 1);
+	restore_flags(flags);
+}
+
+void account_syscall_exit(int32_t ret)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	trace(TRACE_SYSCALL_EXIT, ret);
+	account_time();
+	Find_PCB(current_pid())->in_syscall = 0;
+	restore_flags(flags);
 }
 
 /*
-*   Function: terminal_set()
-*   Description: check terminal status and map video mem
+*   Function: sched_stat_show()
+*   Description: print the cpu usage of every process for the "stat" special file. Times are in
+*                units of 2^20 tsc cycles.
 *   inputs: none
 *   outputs: none
 *   effects: 
 */
-void terminal_set()
+void sched_stat_show()
 {
-    // check if the terminal ran before, if so, execute shell, set initialized flag
-	if (terminal_pid[next_index] == -1) {
-		init_flag = 1;
-		cur_index = next_index;
+	pcb_t* pcb;
+	uint32_t flags;
+	int32_t i;
 
-		//send eoi when done
-		send_eoi(0);
-		system_execute((uint8_t *) "shell");
+	spin_lock_irqsave(&sched_lock, flags);
+	account_time();
+	proc_puts("PID CPU TERM PRIO NICE S     USER   KERNEL  SWITCH   BLOCK COMMAND\n");
+	for (i = 0; i < MAX_PROCESS; i++) {
+		if (pid_status[i] == 0)
+			continue;
+		pcb = Find_PCB(i);
+		proc_putu(i, 3);
+		proc_putu(pcb->cpu, 4);
+		proc_putu(pcb->term, 5);
+		proc_putu(pcb->prio, 5);
+		proc_putu(pcb->nice, 5);
+		proc_puts((cpus[pcb->cpu].cur_pid == i) ? " R" : (pcb->state == TASK_BLOCKED) ? " S" : " W");
+		proc_putu((uint32_t)(pcb->user_tsc >> 20), 9);
+		proc_putu((uint32_t)(pcb->kernel_tsc >> 20), 9);
+		proc_putu(pcb->nr_switches, 8);
+		proc_putu(pcb->nr_blocks, 8);
+		proc_puts(" ");
+		proc_puts((int8_t*)pcb->command_file);
+		proc_puts("\n");
+	}
+	proc_puts("idle ");
+	proc_putu((uint32_t)(idle_tsc >> 20), 0);
+	proc_puts(", ticks ");
+	proc_putu(idle_ticks, 0);
+	proc_puts("/");
+	proc_putu(total_ticks, 0);
+	proc_puts("\n");
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: schedule(void)
+*   Description: give up the cpu, see schedule_locked
+*   inputs: none
+*   outputs: none
+*   effects: returns when the caller is picked again, maybe on another cpu
+*/
+void schedule(void)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	schedule_locked();
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: schedule_locked(void)
+*   Description: give the cpu to the first process of the highest priority level. A running caller
+*                goes to the tail of its level, a blocked or halted caller is left out. With empty queues
+*                a process is stolen from another cpu, failing that the idle task runs until someone
+*                becomes runnable.
+*   inputs: none
+*   outputs: none
+*   effects: returns when the caller is picked again, maybe on another cpu. Called with sched_lock
+*            held, the next context releases it and whoever switches back here holds it again.
+*/
+void schedule_locked(void)
+{
+	int32_t prev, next;
+	pcb_t* next_pcb;
+	uint32_t* prev_esp;
+	run_queue_t* rq = this_rq();
+	cpu_t* cpu = this_cpu();
+
+	timer_charge();
+	prev = cpu->cur_pid;
+	if (prev != -1 && Find_PCB(prev)->state == TASK_RUNNING)
+		queue_add(prev);
+	next = dequeue_process(rq);
+	if (next == -1)
+		next = steal_process();
+
+	if (next != -1)
+		Find_PCB(next)->ticks = slice_ticks[Find_PCB(next)->prio];
+	if (next == prev) {
+		timer_arm();
+		return;
+	}
+
+	account_time();
+	if (prev == -1) {
+		prev_esp = &rq->idle_esp;
 	}
-	// otherwise, calculate current pcb addr, change terminal index and use pid to map new addr to user space
 	else {
-		cur_pcb = (pcb_t *)(EIGHT_MB - EIGHT_KB*(terminal_pid[next_index] + 1));
-		cur_index = next_index;
+		prev_esp = &Find_PCB(prev)->sche_esp;
+		Find_PCB(prev)->nr_switches++;
+		if (Find_PCB(prev)->state == TASK_BLOCKED)
+			Find_PCB(prev)->nr_blocks++;
+		if (Find_PCB(prev)->state == TASK_DEAD)
+			cpu->dead_pid = prev;
+	}
+	cpu->cur_pid = next;
+	timer_arm();
+	irq_exit();		// an interrupt that got here is timed up to the switch
+	trace(TRACE_SWITCH, next);
+	fpu_switch_out(prev);
+	// rq and cpu are stale after the switch
+	if (next == -1) {
+		context_switch(prev_esp, rq->idle_esp);
+	}
+	else {
+		// switch the user space and the kernel stack used on the next interrupt
+		next_pcb = Find_PCB(next);
+		map_user_prog(next_pcb->mm_pid);
+		cpu->tss->ss0 = KERNEL_DS;
+		cpu->tss->esp0 = EIGHT_MB - EIGHT_KB*next;
+		context_switch(prev_esp, next_pcb->sche_esp);
+	}
+	finish_switch();
+}
 
-		map_user_prog(cur_pcb->cur_pid);
+/*
+*   Function: finish_switch()
+*   Description: a halted process is off its kernel stack once the next context runs, only then
+*                can its pid be handed out again
+*   inputs: none
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void finish_switch()
+{
+	cpu_t* cpu = this_cpu();
+
+	if (cpu->dead_pid != -1) {
+		pid_status[cpu->dead_pid] = 0;
+		cpu->dead_pid = -1;
 	}
-	return;
 }
 
 /*
-*   Function: move_registers_out
-*   Description: move esp and ebp
+*   Function: schedule_tail()
+*   Description: first run of a new or forked process, called by process_start_linkage. It finishes
+*                the switch here and drops sched_lock, interrupts stay off until the iret to user mode.
 *   inputs: none
 *   outputs: none
 *   effects: 
 */
-void move_registers_out()
+void schedule_tail()
 {
-	asm volatile(
-	    "movl %%esp, %0 	\n \
-	    movl %%ebp, %1"
-		:"=r"(esp), "=r"(ebp)
-		:
-		: "memory"
-		);
-	return;
+	finish_switch();
+	spin_unlock(&sched_lock);
 }
 
 /*
-*   Function: move_registers_in
-*   Description: move esp and ebp
+*   Function: current_term()
+*   Description: terminal of the running process, the displayed one for the idle task
 *   inputs: none
-*   outputs: none
+*   outputs: terminal index
 *   effects: 
 */
-void move_registers_in()
+int32_t current_term()
 {
-	asm volatile(
-		"movl %0, %%esp  \n 	\
-		 movl %1, %%ebp"
-		 :
-		 : "r"(esp), "r"(ebp)
-		 : "memory"
-		 );
-	return;
+	int32_t p = current_pid();
+
+	return (p == -1) ? (int32_t)display_index : Find_PCB(p)->term;
 }
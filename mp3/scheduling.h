@@ -7,10 +7,14 @@
 #include "paging.h"
 #include "terminal.h"
 #include "x86_desc.h"
+#include "procfs.h"
+#include "smp.h"
 
 /* */
 #define PIT_COMMAND_REG				0x43
 #define PIT_SQUARE_WAVE_MODE 		0x36
+#define PIT_ONESHOT_MODE 			0x30	// channel 0, lobyte/hibyte, interrupt on terminal count
+#define PIT_LATCH_COMMAND 			0x00	// latch the count of channel 0
 #define PIT_CHANNEL_0 				0x40
 #define DIVISOR_MASK                0xFF
 
@@ -23,26 +27,42 @@
 #define VIDEO_MEM 0xB8000
 #define _136MB 0x8800000
 #define dividor_num 11932
+#define NUM_PRIO 4			// priority levels of the feedback queues
+#define BOOST_TICKS 100		// PIT ticks between two priority boosts
+#define ONESHOT_MAX_TICKS 5	// longest one-shot, 5 * dividor_num still fits the 16 bit counter
 /* Divisors for PIT Frequency setting 
  * HZ = 1193180 / HZ_VALUE (ex: HZ = 1193180 / 20);  
  */	
-int terminal_pid[3];
-//extern volatile uint8_t curr_term;
 
+/* idle accounting */
+extern uint32_t total_ticks;
+extern uint32_t idle_ticks;
+extern uint64_t idle_tsc;
 
-int cur_index;
-int next_index;
-int init_flag;
+/* 1: one-shot timer only while processes compete for the cpu, 0: periodic tick */
+extern uint32_t tickless;
 
 /* Initialize RTC */
 void PIT_init(void);
 
 void scheduling(void);
 void sche_init();
-void calculate_pcbaddr();
-void terminal_set();
-void move_registers_out();
-void move_registers_in();
+void sche_start();
+void sche_boot();
+void idle_loop();
+void schedule(void);
+void schedule_locked(void);
+void schedule_tail();
+void sched_tick(uint32_t n);
+void sched_resched();
+void enqueue_process(int32_t p);
+void wake_process(int32_t p);
+int32_t current_term();
+int32_t nice(int32_t inc);
+void account_syscall_enter(uint32_t call);
+void account_syscall_exit(int32_t ret);
+void sched_stat_show();
+int32_t sched_set_tickless(uint32_t on);
 
 
 #endif
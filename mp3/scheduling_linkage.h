@@ -0,0 +1,8 @@
+#ifndef _SCHEDULING_LINKAGE_H
+#define _SCHEDULING_LINKAGE_H
+
+#include "types.h"
+
+extern void context_switch(uint32_t* prev_esp, uint32_t next_esp);
+
+#endif
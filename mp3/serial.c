@@ -0,0 +1,260 @@
+#include "serial.h"
+#include "lib.h"
+#include "i8259.h"
+#include "spinlock.h"
+#include "wait_queue.h"
+#include "bottom_half.h"
+#include "paging.h"
+
+/* 16550 UART on COM1. Writers fill tx_buf and the transmitter interrupt moves
+ * it into the 16 byte FIFO, the receiver interrupt empties the FIFO into
+ * rx_buf. Both rings run freely like the pipes and are changed under
+ * serial_lock. The top half only moves bytes, serial_bh wakes the processes
+ * waiting for them. Kernel messages share the transmit ring through
+ * serial_log, which drops what does not fit instead of waiting. */
+static uint8_t tx_buf[SERIAL_TX_SIZE];
+static volatile uint32_t tx_head;		// next byte to queue
+static volatile uint32_t tx_tail;		// next byte to send
+static uint8_t rx_buf[SERIAL_RX_SIZE];
+static volatile uint32_t rx_head;		// next byte to receive
+static volatile uint32_t rx_tail;		// next byte to read
+static uint32_t uart_ier;				// IER_TX is only on while tx_buf holds data
+static wait_queue_t serial_readq;		// readers waiting for data
+static wait_queue_t serial_writeq;		// writers waiting for room
+static spinlock_t serial_lock = SPINLOCK_INIT("serial");
+
+int32_t serial_present;
+
+/*
+*   Function: tx_fill_locked()
+*   Description: move queued bytes into the transmit FIFO once it is empty, and keep the
+*                transmitter interrupt on for as long as bytes are queued
+*   inputs: none
+*   outputs: none
+*   effects: serial_lock held
+*/
+static void tx_fill_locked(void)
+{
+	uint32_t ier;
+	int32_t n;
+
+	if (inb(COM1 + UART_LSR) & LSR_THRE) {
+		for (n = 0; n < UART_FIFO_SIZE && tx_tail != tx_head; n++) {
+			outb(tx_buf[tx_tail % SERIAL_TX_SIZE], COM1 + UART_DATA);
+			tx_tail++;
+		}
+	}
+	ier = (tx_tail != tx_head) ? (IER_RX | IER_TX) : IER_RX;
+	if (ier != uart_ier) {
+		uart_ier = ier;
+		outb(uart_ier, COM1 + UART_IER);
+	}
+}
+
+/*
+*   Function: serial_bh(uint32_t unused)
+*   Description: bottom half of the serial interrupt, wake the readers and writers
+*   inputs: none
+*   outputs: none
+*   effects: none
+*/
+static void serial_bh(uint32_t unused)
+{
+	wake_up(&serial_readq);
+	wake_up(&serial_writeq);
+}
+
+/*
+*   Function: serial_init()
+*   Description: 115200 baud 8N1 with both FIFOs on, then the receiver interrupt. A port whose
+*                scratch register does not keep a byte has no UART behind it and stays off.
+*   inputs: none
+*   outputs: none
+*   effects: kernel messages are copied to the port from now on
+*/
+void serial_init(void)
+{
+	uint32_t div = 115200 / SERIAL_BAUD;
+	uint32_t flags;
+
+	spin_lock_irqsave(&serial_lock, flags);
+	outb(SCR_PROBE, COM1 + UART_SCR);
+	if (inb(COM1 + UART_SCR) != SCR_PROBE) {
+		spin_unlock_irqrestore(&serial_lock, flags);
+		return;
+	}
+	outb(0, COM1 + UART_IER);
+	outb(LCR_DLAB, COM1 + UART_LCR);
+	outb(div & 0xFF, COM1 + UART_DATA);
+	outb(div >> 8, COM1 + UART_IER);
+	outb(LCR_8N1, COM1 + UART_LCR);
+	outb(FCR_INIT, COM1 + UART_FCR);
+	outb(MCR_INIT, COM1 + UART_MCR);
+	inb(COM1 + UART_LSR);				// clear what is pending from before
+	inb(COM1 + UART_DATA);
+	inb(COM1 + UART_IIR);
+	uart_ier = IER_RX;
+	outb(uart_ier, COM1 + UART_IER);
+	serial_present = 1;
+	spin_unlock_irqrestore(&serial_lock, flags);
+
+	bh_register(SERIAL_IRQ, serial_bh);
+	enable_irq(SERIAL_IRQ);
+}
+
+/*
+*   Function: serial_log(uint8_t c)
+*   Description: kernel log sink, called by putc for every character on the console. A newline
+*                goes out as CR LF. Never waits, a character that does not fit is dropped.
+*   inputs: character
+*   outputs: none
+*   effects: takes serial_lock, must not be called with it held
+*/
+void serial_log(uint8_t c)
+{
+	uint32_t flags;
+
+	if (!serial_present)
+		return;
+	spin_lock_irqsave(&serial_lock, flags);
+	if (c == '\n' && tx_head - tx_tail < SERIAL_TX_SIZE)
+		tx_buf[tx_head++ % SERIAL_TX_SIZE] = '\r';
+	if (tx_head - tx_tail < SERIAL_TX_SIZE)
+		tx_buf[tx_head++ % SERIAL_TX_SIZE] = c;
+	if (!(uart_ier & IER_TX))			// otherwise the transmitter interrupt picks it up
+		tx_fill_locked();
+	spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+*   Function: serial_handler()
+*   Description: top half of the serial interrupt. Empty the receive FIFO into rx_buf and refill
+*                the transmit FIFO until the UART has nothing pending, then queue serial_bh.
+*   inputs: none
+*   outputs: none
+*   effects: received bytes are dropped while rx_buf is full
+*/
+void serial_handler(void)
+{
+	uint8_t c;
+
+	spin_lock(&serial_lock);
+	while (!(inb(COM1 + UART_IIR) & IIR_NONE)) {
+		while (inb(COM1 + UART_LSR) & LSR_DR) {
+			c = inb(COM1 + UART_DATA);
+			if (rx_head - rx_tail < SERIAL_RX_SIZE)
+				rx_buf[rx_head++ % SERIAL_RX_SIZE] = c;
+		}
+		tx_fill_locked();
+	}
+	spin_unlock(&serial_lock);
+	send_eoi(SERIAL_IRQ);
+	bh_queue(SERIAL_IRQ, 0);
+}
+
+/*
+*   int32_t serial_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+*   	DESCRIPTION: 	wait until a byte was received, then copy out as much as is buffered
+*   	INPUT: 			fd, buffer, bytes wanted
+*		OUTPUT: 		bytes read, -1 for a bad buffer or when a signal came first
+*/
+int32_t serial_read(int32_t fd, uint8_t* buf, int32_t nbytes)
+{
+	int32_t count = 0, ret;
+	uint32_t flags;
+
+	if (nbytes < 0 || check_user_range(buf, nbytes, 1) == -1)	// copied under serial_lock
+		return -1;
+	if (nbytes == 0)
+		return 0;
+	while (1) {
+		wait_event_interruptible(&serial_readq, rx_head != rx_tail, ret);
+		if (ret == -1)
+			return -1;
+		spin_lock_irqsave(&serial_lock, flags);
+		if (rx_head != rx_tail)
+			break;
+		spin_unlock_irqrestore(&serial_lock, flags);
+	}
+
+	while (count < nbytes && rx_head != rx_tail)
+		buf[count++] = rx_buf[rx_tail++ % SERIAL_RX_SIZE];
+	spin_unlock_irqrestore(&serial_lock, flags);
+	return count;
+}
+
+/*
+*   int32_t serial_write(int32_t fd, const uint8_t* buf, int32_t nbytes)
+*   	DESCRIPTION: 	queue the whole buffer for sending, waiting for room when the ring is full.
+*   					The bytes go out unchanged, so binary data such as the trace survives.
+*   	INPUT: 			fd, buffer, bytes to write
+*		OUTPUT: 		bytes written, -1 for a bad buffer
+*/
+int32_t serial_write(int32_t fd, const uint8_t* buf, int32_t nbytes)
+{
+	if (nbytes < 0 || check_user_range(buf, nbytes, 0) == -1)	// copied under serial_lock
+		return -1;
+	serial_send(buf, nbytes);
+	return nbytes;
+}
+
+/*
+*   Function: serial_send(const uint8_t* buf, int32_t nbytes)
+*   Description: queue a kernel buffer for sending, waiting for room when the ring is full.
+*                Unlike serial_log nothing is dropped and the bytes go out unchanged.
+*   inputs: buffer, its length
+*   outputs: none
+*   effects: may sleep, does nothing without a UART
+*/
+void serial_send(const uint8_t* buf, int32_t nbytes)
+{
+	int32_t count = 0;
+	uint32_t flags;
+
+	if (!serial_present)
+		return;
+	while (count < nbytes) {
+		wait_event(&serial_writeq, tx_head - tx_tail != SERIAL_TX_SIZE);
+		spin_lock_irqsave(&serial_lock, flags);
+		while (count < nbytes && tx_head - tx_tail != SERIAL_TX_SIZE)
+			tx_buf[tx_head++ % SERIAL_TX_SIZE] = buf[count++];
+		if (!(uart_ier & IER_TX))
+			tx_fill_locked();
+		spin_unlock_irqrestore(&serial_lock, flags);
+	}
+}
+
+/*
+*   int32_t serial_open / serial_close
+*   	DESCRIPTION: 	the port is shared by every process that opens it, there is nothing to set up
+*   	INPUT: 			none / fd
+*		OUTPUT: 		0, -1 from open when there is no UART
+*/
+int32_t serial_open(void)
+{
+	return serial_present ? 0 : -1;
+}
+
+int32_t serial_close(int32_t fd)
+{
+	return 0;
+}
+
+/*
+*   int32_t serial_poll(int32_t fd, poll_table_t* pt)
+*   	DESCRIPTION: 	readiness of the port for poll, the bottom half wakes both queues
+*   	INPUT: 			fd, poll table
+*		OUTPUT: 		POLLIN if a byte was received, POLLOUT if the transmit ring has room
+*/
+int32_t serial_poll(int32_t fd, poll_table_t* pt)
+{
+	int32_t ev = 0;
+
+	poll_wait(pt, &serial_readq);
+	poll_wait(pt, &serial_writeq);
+	if (rx_head != rx_tail)
+		ev |= POLLIN;
+	if (tx_head - tx_tail != SERIAL_TX_SIZE)
+		ev |= POLLOUT;
+	return ev;
+}
@@ -0,0 +1,51 @@
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "types.h"
+#include "poll.h"
+
+#define COM1			0x3F8
+#define SERIAL_IRQ		4
+#define SERIAL_VEC		0x24
+#define SERIAL_NAME		"serial"	// device file, opened by name before the file system is searched
+#define SERIAL_BAUD		115200
+#define SERIAL_TX_SIZE	0x1000		// transmit ring, a power of two
+#define SERIAL_RX_SIZE	0x400		// receive ring, a power of two
+#define UART_FIFO_SIZE	16
+
+/* 16550 registers, offsets from the base port */
+#define UART_DATA		0			// receive/transmit holding, divisor low with DLAB set
+#define UART_IER		1			// interrupt enable, divisor high with DLAB set
+#define UART_IIR		2			// interrupt identification, read
+#define UART_FCR		2			// FIFO control, write
+#define UART_LCR		3
+#define UART_MCR		4
+#define UART_LSR		5
+#define UART_SCR		7
+
+#define IER_RX			0x01		// received data available
+#define IER_TX			0x02		// transmit holding register empty
+#define IIR_NONE		0x01		// no interrupt pending
+#define FCR_INIT		0xC7		// enable and clear both FIFOs, receive trigger at 14 bytes
+#define LCR_8N1			0x03
+#define LCR_DLAB		0x80
+#define MCR_INIT		0x0B		// DTR, RTS and OUT2, which gates the IRQ line on a PC
+#define LSR_DR			0x01		// a received byte is waiting
+#define LSR_THRE		0x20		// transmit FIFO empty
+#define SCR_PROBE		0xAE
+
+extern int32_t serial_present;
+
+void serial_init(void);
+void serial_log(uint8_t c);
+void serial_send(const uint8_t* buf, int32_t nbytes);
+void serial_handler(void);
+
+/* serial file operations */
+int32_t serial_read(int32_t fd, uint8_t* buf, int32_t nbytes);
+int32_t serial_write(int32_t fd, const uint8_t* buf, int32_t nbytes);
+int32_t serial_open(void);
+int32_t serial_close(int32_t fd);
+int32_t serial_poll(int32_t fd, poll_table_t* pt);
+
+#endif
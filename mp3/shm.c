@@ -0,0 +1,204 @@
+#include "shm.h"
+#include "paging.h"
+#include "syscall.h"
+#include "mutex.h"
+
+#define PAGE_PRESENT 0x1
+
+// shared memory segment
+typedef struct shm_seg_t {
+	int32_t key;
+	uint32_t npages;			// 0 when the slot is free
+	uint32_t nattach;			// number of processes that have it mapped
+	uint32_t frame[PTE_num];
+} shm_seg_t;
+
+static shm_seg_t shm_seg[SHM_MAX_SEG];
+static uint32_t shm_base[MAX_PROCESS][SHM_MAX_SEG];	// first page index + 1 of each attachment, 0 if detached
+static mutex_t shm_lock = MUTEX_INIT("shm");			// guards the segments and the attachments
+
+static void shm_map(uint8_t p, int32_t shmid, uint32_t base);
+static void shm_detach(uint8_t p, int32_t shmid);
+
+/*
+*   int32_t shmget(int32_t key, int32_t size)
+*   	DESCRIPTION: 	look up the segment with the given key, creating it with zeroed frames if there
+*						is none yet
+*   	INPUT: 			key shared by the cooperating programs, size in bytes
+*		OUTPUT: 		segment id, -1 if the size is bad or no segment/frame is left
+*/
+int32_t shmget(int32_t key, int32_t size)
+{
+	int32_t i, free_id = -1;
+	uint32_t j, npages;
+
+	if (size <= 0 || size > SHM_MAX_SIZE)
+		return -1;
+	npages = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+
+	mutex_lock(&shm_lock);
+	for (i = 0; i < SHM_MAX_SEG; i++) {
+		if (shm_seg[i].npages == 0) {
+			if (free_id == -1)
+				free_id = i;
+		}
+		else if (shm_seg[i].key == key) {
+			mutex_unlock(&shm_lock);
+			return (npages <= shm_seg[i].npages) ? i : -1;
+		}
+	}
+	if (free_id == -1) {
+		mutex_unlock(&shm_lock);
+		return -1;
+	}
+
+	for (j = 0; j < npages; j++) {
+		shm_seg[free_id].frame[j] = frame_alloc();
+		if (shm_seg[free_id].frame[j] == 0) {
+			while (j-- > 0)
+				frame_put(shm_seg[free_id].frame[j]);
+			mutex_unlock(&shm_lock);
+			return -1;
+		}
+		memset((void*)shm_seg[free_id].frame[j], 0, FRAME_SIZE);
+	}
+	shm_seg[free_id].key = key;
+	shm_seg[free_id].npages = npages;
+	shm_seg[free_id].nattach = 0;
+	mutex_unlock(&shm_lock);
+	return free_id;
+}
+
+/*
+*   int32_t shmat(int32_t shmid)
+*   	DESCRIPTION: 	map the segment's frames into the shared memory window of the caller
+*   	INPUT: 			segment id
+*		OUTPUT: 		user address of the segment, -1 on failure
+*/
+int32_t shmat(int32_t shmid)
+{
+	int32_t cur = current_pid();
+	uint32_t base, run;
+
+	if (shmid < 0 || shmid >= SHM_MAX_SEG)
+		return -1;
+	mutex_lock(&shm_lock);
+	if (shm_seg[shmid].npages == 0) {
+		mutex_unlock(&shm_lock);
+		return -1;
+	}
+	if (shm_base[cur][shmid] != 0) {
+		mutex_unlock(&shm_lock);
+		return USER_SHM_START + (shm_base[cur][shmid] - 1) * FRAME_SIZE;
+	}
+
+	// first fit for npages consecutive free pages of the window
+	run = 0;
+	for (base = 0; base < PTE_num && run < shm_seg[shmid].npages; base++) {
+		if (shm_page(cur, USER_SHM_START + base * FRAME_SIZE) & PAGE_PRESENT)
+			run = 0;
+		else
+			run++;
+	}
+	if (run < shm_seg[shmid].npages) {
+		mutex_unlock(&shm_lock);
+		return -1;
+	}
+	base -= run;
+
+	shm_map(cur, shmid, base);
+	mutex_unlock(&shm_lock);
+	return USER_SHM_START + base * FRAME_SIZE;
+}
+
+/*
+*   int32_t shmdt(void* addr)
+*   	DESCRIPTION: 	unmap the segment attached at addr. The segment is destroyed once the last
+*						process detaches from it.
+*   	INPUT: 			address returned by shmat
+*		OUTPUT: 		0 on success, -1 if nothing is attached there
+*/
+int32_t shmdt(void* addr)
+{
+	int32_t cur = current_pid();
+	int32_t i;
+
+	mutex_lock(&shm_lock);
+	for (i = 0; i < SHM_MAX_SEG; i++) {
+		if (shm_base[cur][i] != 0 &&
+			USER_SHM_START + (shm_base[cur][i] - 1) * FRAME_SIZE == (uint32_t)addr) {
+			shm_detach(cur, i);
+			mutex_unlock(&shm_lock);
+			return 0;
+		}
+	}
+	mutex_unlock(&shm_lock);
+	return -1;
+}
+
+/*
+*   void shm_fork(uint8_t parent, uint8_t child)
+*   	DESCRIPTION: 	the child of fork shares every segment of the parent at the same address
+*   	INPUT: 			parent pid, child pid
+*		OUTPUT: 		none
+*/
+void shm_fork(uint8_t parent, uint8_t child)
+{
+	int32_t i;
+
+	mutex_lock(&shm_lock);
+	for (i = 0; i < SHM_MAX_SEG; i++) {
+		shm_base[child][i] = 0;
+		if (shm_base[parent][i] != 0)
+			shm_map(child, i, shm_base[parent][i] - 1);
+	}
+	mutex_unlock(&shm_lock);
+}
+
+/*
+*   void shm_exit(uint8_t p)
+*   	DESCRIPTION: 	detach every segment of a halting process
+*   	INPUT: 			pid
+*		OUTPUT: 		none
+*/
+void shm_exit(uint8_t p)
+{
+	int32_t i;
+
+	mutex_lock(&shm_lock);
+	for (i = 0; i < SHM_MAX_SEG; i++) {
+		if (shm_base[p][i] != 0)
+			shm_detach(p, i);
+	}
+	mutex_unlock(&shm_lock);
+}
+
+/**************** Helper Function ************************/
+static void shm_map(uint8_t p, int32_t shmid, uint32_t base)
+{
+	uint32_t i;
+
+	for (i = 0; i < shm_seg[shmid].npages; i++) {
+		frame_get(shm_seg[shmid].frame[i]);
+		map_shm_page(p, USER_SHM_START + (base + i) * FRAME_SIZE, shm_seg[shmid].frame[i]);
+	}
+	shm_base[p][shmid] = base + 1;
+	shm_seg[shmid].nattach++;
+}
+
+static void shm_detach(uint8_t p, int32_t shmid)
+{
+	uint32_t i, base = shm_base[p][shmid] - 1;
+
+	for (i = 0; i < shm_seg[shmid].npages; i++) {
+		map_shm_page(p, USER_SHM_START + (base + i) * FRAME_SIZE, 0);
+		frame_put(shm_seg[shmid].frame[i]);
+	}
+	shm_base[p][shmid] = 0;
+
+	if (--shm_seg[shmid].nattach == 0) {
+		for (i = 0; i < shm_seg[shmid].npages; i++)
+			frame_put(shm_seg[shmid].frame[i]);
+		shm_seg[shmid].npages = 0;
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+
+#define SHM_MAX_SEG		8			// number of shared memory segments in the system
+#define SHM_MAX_SIZE	0x400000	// a segment fills at most the whole 4MB window
+
+/* Shared memory system calls */
+int32_t shmget(int32_t key, int32_t size);
+int32_t shmat(int32_t shmid);
+int32_t shmdt(void* addr);
+
+/* process lifetime hooks */
+void shm_fork(uint8_t parent, uint8_t child);
+void shm_exit(uint8_t p);
+
+#endif
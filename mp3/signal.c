@@ -0,0 +1,233 @@
+#include "signal.h"
+#include "syscall.h"
+
+/* A signal is a bit in sig_pending of the process. Every return to user
+ * mode, from a system call, an interrupt or a fault, passes signal_exit,
+ * which delivers the lowest pending signal: the default action halts the
+ * process or drops the signal, a handler is entered with a sigframe_t
+ * pushed below the user stack pointer. While it runs the other signals with
+ * a handler stay pending, until the handler returns through sigreturn. A
+ * signal for a process running on another cpu kicks that cpu, so it is
+ * delivered when the IPI returns to user mode. */
+
+/* movl $SYS_SIGRETURN, %eax; int $0x80 */
+static const uint8_t sigreturn_code[8] = { 0xB8, SYS_SIGRETURN, 0, 0, 0, 0xCD, 0x80, 0x90 };
+
+/*
+*   Function: signal_send_locked(int32_t p, int32_t sig)
+*   Description: make a signal pending for a process. A sleeping process is woken, whatever wait
+*                queue it is on: nanosleep, poll and the wait_event_interruptible reads return
+*                early, the other waits go back to sleep until their event.
+*   inputs: pid, signal
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void signal_send_locked(int32_t p, int32_t sig)
+{
+	pcb_t* pcb = Find_PCB(p);
+
+	pcb->sig_pending |= 1 << sig;
+	if (pcb->state == TASK_BLOCKED)
+		wake_process(p);
+	else if (pcb->cpu != this_cpu()->id && cpus[pcb->cpu].cur_pid == p)
+		smp_kick(pcb->cpu);
+}
+
+/*
+*   Function: signal_send(int32_t p, int32_t sig)
+*   Description: send a signal to a process
+*   inputs: pid, signal
+*   outputs: none
+*   effects: safe to call from interrupt handlers
+*/
+void signal_send(int32_t p, int32_t sig)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	if (pid_status[p] != 0 && Find_PCB(p)->state != TASK_DEAD)
+		signal_send_locked(p, sig);
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: signal_fault(int32_t sig)
+*   Description: a fault of the running process in user mode. A fault in a handler would only come
+*                back after sigreturn, so it takes the default action.
+*   inputs: signal
+*   outputs: none
+*   effects: delivered by signal_exit at the end of the exception
+*/
+void signal_fault(int32_t sig)
+{
+	int32_t cur = current_pid();
+	pcb_t* pcb = Find_PCB(cur);
+
+	if (pcb->sig_active)
+		pcb->sig_handler[sig] = 0;
+	signal_send(cur, sig);
+}
+
+/*
+*   Function: signal_terminal(int32_t term, int32_t sig)
+*   Description: send a signal to every process of a terminal but the shell at its root
+*   inputs: terminal, signal
+*   outputs: none
+*   effects: safe to call from interrupt handlers
+*/
+void signal_terminal(int32_t term, int32_t sig)
+{
+	pcb_t* pcb;
+	uint32_t flags;
+	int32_t p;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	for (p = 0; p < MAX_PROCESS; p++) {
+		pcb = Find_PCB(p);
+		if (pid_status[p] != 0 && pcb->state != TASK_DEAD && pcb->term == term && pcb->prev_pid != -1)
+			signal_send_locked(p, sig);
+	}
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: signal_pending_locked()
+*   Description: whether a signal that is not ignored waits for the running process, a sleep ends
+*                early for it
+*   inputs: none
+*   outputs: 1 if so, 0 otherwise
+*   effects: sched_lock held
+*/
+int32_t signal_pending_locked(void)
+{
+	pcb_t* pcb = Find_PCB(current_pid());
+	uint32_t wanted = SIG_KILL_MASK;
+	int32_t sig;
+
+	for (sig = 0; sig < SIG_NUM; sig++) {
+		if (pcb->sig_handler[sig] != 0)
+			wanted |= 1 << sig;
+	}
+	return (pcb->sig_pending & wanted) != 0;
+}
+
+/*
+*   Function: signal_exit(irq_frame_t* regs)
+*   Description: deliver the pending signals before a return to user mode. Ignored signals are
+*                dropped, a signal that kills halts the process, the first one with a handler
+*                changes regs to enter it. A user stack without room for the frame halts the
+*                process too.
+*   inputs: registers the linkage restores before its iret
+*   outputs: none
+*   effects: does not return when the process is halted
+*/
+void signal_exit(irq_frame_t* regs)
+{
+	pcb_t* pcb;
+	sigframe_t* frame;
+	void* handler;
+	uint32_t flags, ready;
+	int32_t sig;
+
+	if ((regs->cs & 3) != 3)		// back to the kernel, the signal waits for its return to user mode
+		return;
+	pcb = Find_PCB(current_pid());
+
+	while (1) {
+		spin_lock_irqsave(&sched_lock, flags);
+		ready = pcb->sig_pending;
+		if (pcb->sig_active) {
+			for (sig = 0; sig < SIG_NUM; sig++) {
+				if (pcb->sig_handler[sig] != 0)
+					ready &= ~(1 << sig);
+			}
+		}
+		for (sig = 0; sig < SIG_NUM && !(ready & (1 << sig)); sig++);
+		if (sig == SIG_NUM) {
+			spin_unlock_irqrestore(&sched_lock, flags);
+			return;
+		}
+		pcb->sig_pending &= ~(1 << sig);
+		handler = pcb->sig_handler[sig];
+		spin_unlock_irqrestore(&sched_lock, flags);
+
+		if (handler != 0)
+			break;
+		if (SIG_KILL_MASK & (1 << sig)) {
+			sti();
+			process_exit(SIG_KILL_STATUS);
+		}
+	}
+
+	frame = (sigframe_t*)((regs->esp - sizeof(sigframe_t)) & ~3);
+	if (check_user_range(frame, sizeof(sigframe_t), 1) == -1) {
+		sti();						// no stack to run the handler on
+		process_exit(SIG_KILL_STATUS);
+	}
+	frame->ret = (uint32_t)frame->code;
+	frame->signum = sig;
+	frame->ctx.eax = regs->eax;
+	frame->ctx.ebx = regs->ebx;
+	frame->ctx.ecx = regs->ecx;
+	frame->ctx.edx = regs->edx;
+	frame->ctx.esi = regs->esi;
+	frame->ctx.edi = regs->edi;
+	frame->ctx.ebp = regs->ebp;
+	frame->ctx.eip = regs->eip;
+	frame->ctx.eflags = regs->eflags;
+	frame->ctx.esp = regs->esp;
+	memcpy(frame->code, sigreturn_code, sizeof(sigreturn_code));
+
+	pcb->sig_active = 1;
+	regs->esp = (uint32_t)frame;
+	regs->eip = (uint32_t)handler;
+}
+
+/*
+*   int32_t set_handler(int32_t signum, void* handler_address)
+*   	DESCRIPTION: 	set the handler of a signal, it is called with the signal number as argument
+*   	INPUT: 			signal, handler, 0 for the default action
+*		OUTPUT: 		0, -1 for a bad signal or handler
+*/
+int32_t set_handler(int32_t signum, void* handler_address)
+{
+	if (signum < 0 || signum >= SIG_NUM)
+		return -1;
+	if (handler_address != NULL && (uint32_t)handler_address <= INVALID_ADDR)
+		return -1;
+	Find_PCB(current_pid())->sig_handler[signum] = handler_address;
+	return 0;
+}
+
+/*
+*   int32_t sigreturn(void)
+*   	DESCRIPTION: 	made by the code of the signal frame when a handler returns. Copies the
+*   					registers of the frame back into the syscall frame on the kernel stack, so
+*   					the process goes on where the signal stopped it. A frame the process cannot
+*   					have written halts it.
+*   	INPUT: 			none
+*		OUTPUT: 		eax of the interrupted code, -1 if no handler runs
+*/
+int32_t sigreturn(void)
+{
+	int32_t cur = current_pid();
+	pcb_t* pcb = Find_PCB(cur);
+	syscall_frame_t* frame = (syscall_frame_t*)(EIGHT_MB - EIGHT_KB*cur) - 1;
+	sigcontext_t* ctx = (sigcontext_t*)(frame->esp + 4);	// the handler's ret took the return address
+
+	if (!pcb->sig_active)
+		return -1;
+	if (check_user_range(ctx, sizeof(sigcontext_t), 0) == -1)
+		process_exit(SIG_KILL_STATUS);
+	frame->ebx = ctx->ebx;
+	frame->ecx = ctx->ecx;
+	frame->edx = ctx->edx;
+	frame->esi = ctx->esi;
+	frame->edi = ctx->edi;
+	frame->ebp = ctx->ebp;
+	frame->eip = ctx->eip;
+	frame->esp = ctx->esp;
+	frame->eflags = (frame->eflags & ~EFLAGS_USER_MASK) | (ctx->eflags & EFLAGS_USER_MASK);
+	pcb->sig_active = 0;
+	return ctx->eax;
+}
@@ -0,0 +1,70 @@
+#ifndef _SIGNAL_H
+#define _SIGNAL_H
+
+#include "types.h"
+
+/* signal numbers of the MP3 specification */
+#define SIGFPE			0			// divide error and floating point faults
+#define SIGSEGV			1			// every other fault of a user process
+#define SIGINT			2			// ctrl+c on the terminal
+#define SIGALRM			3
+#define SIGUSR1			4
+#define SIG_NUM			5
+#define SIG_KILL_MASK	((1 << SIGFPE) | (1 << SIGSEGV) | (1 << SIGINT))	// halt by default, the others are ignored
+#define SIG_KILL_STATUS	256			// execute returns this for a process killed by a signal
+#define SYS_SIGRETURN	10
+#define EFLAGS_USER_MASK 0x0CD5		// CF PF AF ZF SF DF OF, the flags a handler may hand back to sigreturn
+
+/* Kernel stack of an interrupt linkage after pushfl and pushal. The syscall
+ * and exception linkages rebuild the same layout before the iret. */
+typedef struct irq_frame_t {
+	uint32_t edi;			// pushal
+	uint32_t esi;
+	uint32_t ebp;
+	uint32_t kernel_esp;
+	uint32_t ebx;
+	uint32_t edx;
+	uint32_t ecx;
+	uint32_t eax;
+	uint32_t kernel_eflags;	// pushfl
+	uint32_t eip;			// pushed by the processor
+	uint32_t cs;
+	uint32_t eflags;
+	uint32_t esp;			// only on an entry from user mode
+	uint32_t ss;
+} irq_frame_t;
+
+/* user registers at the time of the signal, sigreturn puts them back */
+typedef struct sigcontext_t {
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+	uint32_t esi;
+	uint32_t edi;
+	uint32_t ebp;
+	uint32_t eip;
+	uint32_t eflags;
+	uint32_t esp;
+} sigcontext_t;
+
+/* Pushed on the user stack to enter a handler. The handler returns into
+ * code, which makes the sigreturn system call. */
+typedef struct sigframe_t {
+	uint32_t ret;
+	int32_t signum;			// argument of the handler
+	sigcontext_t ctx;
+	uint8_t code[8];
+} sigframe_t;
+
+void signal_send(int32_t p, int32_t sig);
+void signal_fault(int32_t sig);
+void signal_terminal(int32_t term, int32_t sig);
+int32_t signal_pending_locked(void);
+void signal_exit(irq_frame_t* regs);
+
+/* system calls */
+int32_t set_handler(int32_t signum, void* handler_address);
+int32_t sigreturn(void);
+
+#endif
@@ -0,0 +1,382 @@
+#include "smp.h"
+#include "apic.h"
+#include "lib.h"
+#include "syscall.h"
+#include "scheduling.h"
+
+#define EBDA_SEG_PTR	0x40E		// BIOS data area: segment of the extended BIOS data area
+#define BASE_MEM_PTR	0x413		// BIOS data area: KB of base memory
+#define BIOS_ROM_START	0xF0000
+#define BIOS_ROM_SIZE	0x10000
+#define MP_FP_ALIGN		16
+#define SIPI_VECTOR		(AP_TRAMPOLINE >> 12)
+#define AP_START_WAIT	1000000		// port 0x80 reads to wait for an AP, about a second
+#define DELAY_PORT		0x80
+
+cpu_t cpus[MAX_CPU];
+int32_t cpu_num;
+int32_t cpu_found;
+uint32_t ioapic_addr;
+uint8_t ioapic_id;
+
+/* idle stacks, the boot cpu moves here in sche_start and the APs start on theirs */
+uint8_t cpu_stack[MAX_CPU][CPU_STACK_SIZE] __attribute__((aligned(CPU_STACK_SIZE)));
+/* page directories of the APs, copied from the boot cpu's page_dir */
+static uint32_t cpu_dir[MAX_CPU][PDE_num] __attribute__((aligned(PDE_size)));
+
+/* read by smp_linkage while an AP starts */
+uint32_t ap_stack;
+uint32_t ap_page_dir;
+static volatile int32_t ap_booting;
+
+extern uint8_t ap_trampoline[], ap_trampoline_end[], ap_gdtr[];
+
+/*
+*   Function: this_cpu()
+*   Description: find the cpu we run on. Every kernel context runs either on the kernel stack of a
+*                process, whose pcb records its cpu, or on the idle stack of a cpu.
+*   inputs: none
+*   outputs: per-cpu state
+*   effects: a process may move to another cpu when it is preempted, so the answer only holds
+*            while interrupts are off
+*/
+cpu_t* this_cpu(void)
+{
+	uint32_t esp;
+	int32_t i;
+
+	if (cpu_num <= 1)
+		return &cpus[0];
+	asm volatile("movl %%esp, %0" : "=r"(esp));
+	if (esp < EIGHT_MB && esp >= EIGHT_MB - EIGHT_KB * MAX_PROCESS)
+		return &cpus[Find_PCB((EIGHT_MB - 1 - esp) / EIGHT_KB)->cpu];
+	for (i = 0; i < cpu_num; i++) {
+		if (esp > (uint32_t)cpu_stack[i] && esp <= (uint32_t)cpu_stack[i] + CPU_STACK_SIZE)
+			return &cpus[i];
+	}
+	return &cpus[0];
+}
+
+/*
+*   Function: mp_checksum(uint8_t* addr, uint32_t len)
+*   Description: MP structures are valid when their bytes sum up to 0
+*   inputs: start, length in bytes
+*   outputs: byte sum
+*   effects:
+*/
+static uint8_t mp_checksum(uint8_t* addr, uint32_t len)
+{
+	uint8_t sum = 0;
+
+	while (len--)
+		sum += *addr++;
+	return sum;
+}
+
+/*
+*   Function: mp_search(uint32_t start, uint32_t len)
+*   Description: look for the MP floating pointer on 16 byte boundaries of a physical range
+*   inputs: start, length in bytes
+*   outputs: the floating pointer, 0 if there is none
+*   effects:
+*/
+static mp_fp_t* mp_search(uint32_t start, uint32_t len)
+{
+	uint32_t addr;
+
+	for (addr = start; addr + sizeof(mp_fp_t) <= start + len; addr += MP_FP_ALIGN) {
+		if (strncmp((int8_t*)addr, (int8_t*)"_MP_", 4) == 0 &&
+				mp_checksum((uint8_t*)addr, sizeof(mp_fp_t)) == 0)
+			return (mp_fp_t*)addr;
+	}
+	return 0;
+}
+
+/*
+*   Function: mp_find()
+*   Description: the MP floating pointer is in the first KB of the EBDA, the last KB of base
+*                memory or the BIOS ROM
+*   inputs: none
+*   outputs: the floating pointer, 0 on a single processor machine
+*   effects:
+*/
+static mp_fp_t* mp_find()
+{
+	mp_fp_t* fp;
+	uint32_t addr;
+
+	addr = *(uint16_t*)EBDA_SEG_PTR << 4;
+	if (addr != 0 && (fp = mp_search(addr, 1024)) != 0)
+		return fp;
+	addr = *(uint16_t*)BASE_MEM_PTR * 1024;
+	if ((fp = mp_search(addr - 1024, 1024)) != 0)
+		return fp;
+	return mp_search(BIOS_ROM_START, BIOS_ROM_SIZE);
+}
+
+/*
+*   Function: smp_init()
+*   Description: list the processors, the I/O APIC and the pins of the ISA IRQs from the MP
+*                configuration table and copy
+*                the AP trampoline below 1MB. Runs before paging, while every physical address
+*                can be read.
+*   inputs: none
+*   outputs: none
+*   effects: without a table only the boot cpu is used
+*/
+void smp_init(void)
+{
+	mp_fp_t* fp;
+	mp_conf_t* conf;
+	mp_proc_t* proc;
+	mp_ioapic_t* io;
+	mp_bus_t* bus;
+	mp_iointr_t* intr;
+	uint8_t* entry;
+	int32_t i, n, isa_bus = -1;
+
+	cpus[0].id = 0;
+	cpus[0].started = 1;
+	cpus[0].cur_pid = -1;
+	cpus[0].dead_pid = -1;
+	cpus[0].fpu_owner = -1;
+	cpus[0].mapped_pid = -1;
+	cpus[0].page_dir = page_dir;
+	cpus[0].tss = &tss;
+	cpu_num = 1;
+	cpu_found = 1;
+	ioapic_addr = 0;
+
+	fp = mp_find();
+	if (fp == 0 || fp->config == 0)
+		return;
+	conf = (mp_conf_t*)fp->config;
+	if (strncmp((int8_t*)conf->signature, (int8_t*)"PCMP", 4) != 0 ||
+			mp_checksum((uint8_t*)conf, conf->length) != 0)
+		return;
+	lapic_base = conf->lapic_addr;
+
+	n = 1;
+	entry = (uint8_t*)(conf + 1);
+	for (i = 0; i < conf->entries; i++) {
+		switch (*entry) {
+		case MP_PROC:
+			proc = (mp_proc_t*)entry;
+			if (proc->flags & MP_CPU_BP) {
+				cpus[0].apic_id = proc->apic_id;
+			}
+			else if ((proc->flags & MP_CPU_EN) && n < MAX_CPU) {
+				cpus[n].apic_id = proc->apic_id;
+				n++;
+			}
+			entry += MP_PROC_SIZE;
+			break;
+		case MP_IOAPIC:
+			io = (mp_ioapic_t*)entry;
+			if (ioapic_addr == 0 && (io->flags & MP_CPU_EN)) {
+				ioapic_addr = io->addr;
+				ioapic_id = io->apic_id;
+			}
+			entry += MP_ENTRY_SIZE;
+			break;
+		case MP_BUS:
+			bus = (mp_bus_t*)entry;
+			if (strncmp((int8_t*)bus->bus_type, (int8_t*)"ISA", 3) == 0)
+				isa_bus = bus->bus_id;
+			entry += MP_ENTRY_SIZE;
+			break;
+		case MP_IOINTR:
+			// the bus entries come first, an ISA IRQ can be wired to another pin (the PIT to pin 2)
+			intr = (mp_iointr_t*)entry;
+			if (intr->intr_type == MP_INT && intr->src_bus == isa_bus && intr->src_irq < ISA_IRQS)
+				ioapic_pin[intr->src_irq] = intr->dst_pin;
+			entry += MP_ENTRY_SIZE;
+			break;
+		default:
+			entry += MP_ENTRY_SIZE;
+			break;
+		}
+	}
+	cpu_found = n;
+	if (cpu_found == 1)
+		return;
+
+	// the trampoline loads the boot cpu's gdt, each AP switches to its own copy in ap_main
+	memcpy((void*)AP_TRAMPOLINE, ap_trampoline, ap_trampoline_end - ap_trampoline);
+	*(uint16_t*)(AP_TRAMPOLINE + (ap_gdtr - ap_trampoline)) = GDT_ENTRIES * sizeof(seg_desc_t) - 1;
+	*(uint32_t*)(AP_TRAMPOLINE + (ap_gdtr - ap_trampoline) + 2) = (uint32_t)(&gdt_ptr - 2);
+}
+
+/*
+*   Function: smp_delay(uint32_t n)
+*   Description: wait about n microseconds, one ISA port read each
+*   inputs: number of microseconds
+*   outputs: none
+*   effects:
+*/
+static void smp_delay(uint32_t n)
+{
+	while (n--)
+		inb(DELAY_PORT);
+}
+
+/*
+*   Function: cpu_setup(int32_t i)
+*   Description: give an AP its own gdt with a tss of its own, and its own page directory
+*   inputs: cpu index
+*   outputs: none
+*   effects:
+*/
+static void cpu_setup(int32_t i)
+{
+	cpu_t* cpu = &cpus[i];
+	seg_desc_t* gdt = &gdt_ptr - 2;
+	int32_t j;
+
+	cpu->id = i;
+	cpu->started = 0;
+	cpu->cur_pid = -1;
+	cpu->dead_pid = -1;
+	cpu->fpu_owner = -1;
+	cpu->mapped_pid = -1;
+	cpu->tlb_stale = 0;
+
+	memset(&cpu->ap_tss, 0, sizeof(tss_t));
+	cpu->ap_tss.ldt_segment_selector = KERNEL_LDT;
+	cpu->ap_tss.ss0 = KERNEL_DS;
+	cpu->ap_tss.esp0 = (uint32_t)cpu_stack[i] + CPU_STACK_SIZE;
+	cpu->tss = &cpu->ap_tss;
+
+	for (j = 0; j < GDT_ENTRIES; j++)
+		cpu->gdt[j] = gdt[j];
+	SET_TSS_PARAMS(cpu->gdt[TSS_ENTRY], &cpu->ap_tss, tss_size);
+	cpu->gdt[TSS_ENTRY].type = 0x9;		// available, ltr marks it busy
+	cpu->gdt_desc.size = sizeof(cpu->gdt) - 1;
+	cpu->gdt_desc.addr = (uint32_t)cpu->gdt;
+
+	cpu->page_dir = cpu_dir[i];
+	memcpy(cpu->page_dir, page_dir, PDE_size);
+}
+
+/*
+*   Function: smp_boot_aps()
+*   Description: start the other cpus with INIT and STARTUP IPIs, one at a time. In APIC mode every
+*                cpu has its own local APIC timer. Otherwise the PIT goes back to periodic ticks,
+*                which the boot cpu forwards to the others.
+*   inputs: none
+*   outputs: none
+*   effects: called by the boot cpu
+*/
+void smp_boot_aps(void)
+{
+	int32_t i;
+	uint32_t wait;
+
+	if (cpu_found == 1)
+		return;
+	if (!apic_mode) {
+		lapic_init(1);
+		cpus[0].apic_id = lapic_id();
+		tickless = 0;
+		PIT_init();
+	}
+
+	for (i = 1; i < cpu_found; i++) {
+		cpu_setup(i);
+		ap_booting = i;
+		ap_stack = (uint32_t)cpu_stack[i] + CPU_STACK_SIZE;
+		ap_page_dir = (uint32_t)cpus[i].page_dir;
+		cpu_num = i + 1;		// lets this_cpu find the new idle stack
+
+		lapic_ipi(cpus[i].apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+		smp_delay(200);
+		lapic_ipi(cpus[i].apic_id, ICR_INIT | ICR_LEVEL);
+		smp_delay(10000);
+		lapic_ipi(cpus[i].apic_id, ICR_STARTUP | SIPI_VECTOR);
+		smp_delay(200);
+		lapic_ipi(cpus[i].apic_id, ICR_STARTUP | SIPI_VECTOR);
+
+		for (wait = 0; wait < AP_START_WAIT && !cpus[i].started; wait++)
+			smp_delay(1);
+		if (!cpus[i].started) {
+			cpu_num = i;
+			break;
+		}
+	}
+}
+
+/*
+*   Function: ap_main()
+*   Description: C entry of an AP, on its idle stack with paging on. Loads its own gdt and tss,
+*                enables its local APIC and the SIMD copies, starts its timer in APIC mode and
+*                becomes the idle task of the cpu.
+*   inputs: none
+*   outputs: none
+*   effects: never returns
+*/
+void ap_main(void)
+{
+	cpu_t* cpu = &cpus[ap_booting];
+
+	asm volatile("lgdt (%0)" : : "r"(&cpu->gdt_desc.size) : "memory");
+	ltr(KERNEL_TSS);
+	lldt(KERNEL_LDT);
+	lapic_init(0);
+	simd_cpu_init();
+	if (apic_mode)
+		PIT_init();
+	cpu->started = 1;
+
+	idle_loop();
+}
+
+/*
+*   Function: smp_kick(int32_t cpu)
+*   Description: make another cpu look at its run queue
+*   inputs: cpu index
+*   outputs: none
+*   effects:
+*/
+void smp_kick(int32_t cpu)
+{
+	lapic_ipi(cpus[cpu].apic_id, ICR_FIXED | IPI_RESCHED);
+}
+
+/*
+*   Function: tlb_shootdown()
+*   Description: a mapping every cpu shares (video memory) changed. The other cpus flush on the IPI,
+*                or before they touch video memory under term_lock if interrupts are off meanwhile.
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void tlb_shootdown(void)
+{
+	int32_t i;
+
+	flush_tlb();
+	if (cpu_num <= 1)
+		return;
+	for (i = 0; i < cpu_num; i++) {
+		if (&cpus[i] != this_cpu())
+			cpus[i].tlb_stale = 1;
+	}
+	lapic_ipi_others(ICR_FIXED | IPI_TLB);
+}
+
+/*
+*   Function: tlb_sync()
+*   Description: carry out a shootdown aimed at this cpu
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void tlb_sync(void)
+{
+	cpu_t* cpu = this_cpu();
+
+	if (cpu->tlb_stale) {
+		cpu->tlb_stale = 0;
+		flush_tlb();
+	}
+}
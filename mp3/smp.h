@@ -0,0 +1,130 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "types.h"
+#include "x86_desc.h"
+#include "paging.h"
+
+#define MAX_CPU			4
+#define CPU_STACK_SIZE	0x2000		// idle stack of every cpu, also the boot stack of an AP
+#define GDT_ENTRIES		8			// two null entries, kernel and user CS/DS, TSS and LDT
+#define TSS_ENTRY		6
+
+/* interprocessor interrupt vectors */
+#define IPI_TICK		0xF0		// PIT tick forwarded by the boot cpu
+#define IPI_RESCHED		0xF1		// a process was queued for this cpu
+#define IPI_TLB			0xF2		// a mapping shared by every cpu changed
+
+#define AP_TRAMPOLINE	0x7000		// real mode entry of the APs, SIPI vector 0x07
+
+/* MP floating pointer structure, "_MP_" (Intel MultiProcessor Specification 1.4) */
+typedef struct __attribute__((packed)) mp_fp_t {
+	uint8_t signature[4];
+	uint32_t config;			// physical address of the configuration table
+	uint8_t length;				// in 16 byte units
+	uint8_t spec_rev;
+	uint8_t checksum;
+	uint8_t type;				// nonzero selects a default configuration, no table
+	uint8_t features[4];
+} mp_fp_t;
+
+/* MP configuration table header, "PCMP" */
+typedef struct __attribute__((packed)) mp_conf_t {
+	uint8_t signature[4];
+	uint16_t length;
+	uint8_t spec_rev;
+	uint8_t checksum;
+	uint8_t oem[20];
+	uint32_t oem_table;
+	uint16_t oem_length;
+	uint16_t entries;
+	uint32_t lapic_addr;
+	uint16_t ext_length;
+	uint8_t ext_checksum;
+	uint8_t reserved;
+} mp_conf_t;
+
+/* configuration table entries */
+#define MP_PROC			0
+#define MP_BUS			1
+#define MP_IOAPIC		2
+#define MP_IOINTR		3
+#define MP_LINTR		4
+#define MP_PROC_SIZE	20			// every other entry is 8 bytes
+#define MP_ENTRY_SIZE	8
+#define MP_CPU_EN		0x01
+#define MP_CPU_BP		0x02
+
+typedef struct __attribute__((packed)) mp_proc_t {
+	uint8_t type;
+	uint8_t apic_id;
+	uint8_t apic_ver;
+	uint8_t flags;				// MP_CPU_EN, MP_CPU_BP
+	uint32_t signature;
+	uint32_t features;
+	uint32_t reserved[2];
+} mp_proc_t;
+
+typedef struct __attribute__((packed)) mp_ioapic_t {
+	uint8_t type;
+	uint8_t apic_id;
+	uint8_t apic_ver;
+	uint8_t flags;
+	uint32_t addr;
+} mp_ioapic_t;
+
+typedef struct __attribute__((packed)) mp_bus_t {
+	uint8_t type;
+	uint8_t bus_id;
+	uint8_t bus_type[6];		// "ISA   ", "PCI   "
+} mp_bus_t;
+
+/* I/O APIC pin an interrupt source is wired to */
+#define MP_INT			0			// vectored interrupt, the others are NMI, SMI and ExtINT
+typedef struct __attribute__((packed)) mp_iointr_t {
+	uint8_t type;
+	uint8_t intr_type;
+	uint16_t flags;				// polarity and trigger mode
+	uint8_t src_bus;
+	uint8_t src_irq;
+	uint8_t dst_apic;
+	uint8_t dst_pin;
+} mp_iointr_t;
+
+/* per-cpu state, cpus[0] is the boot cpu */
+typedef struct cpu_t {
+	int32_t id;
+	uint8_t apic_id;
+	volatile int32_t started;
+	int32_t cur_pid;			// running process, -1 for the idle task
+	int32_t dead_pid;			// halted process switched away from, its pid is freed by the next context
+	int32_t mapped_pid;			// pid whose page tables are installed at 128MB
+	volatile int32_t tlb_stale;	// flush before touching shared mappings again
+	uint32_t irq_vec;			// interrupt being timed by irq_enter/irq_exit
+	uint64_t irq_start;			// its tsc at entry, 0 when none is
+	int32_t fpu_owner;			// pid whose FPU registers this cpu holds, -1 for none
+	int32_t bh_active;			// running the bottom halves, not preempted until they are done
+	int32_t fpu_kernel;			// the kernel uses the FPU registers, not preempted until it is done
+	uint32_t* page_dir;			// every cpu maps its own process at 128MB
+	tss_t* tss;					// kernel stack for interrupts from user mode
+	tss_t ap_tss;
+	seg_desc_t gdt[GDT_ENTRIES];
+	x86_desc_t gdt_desc;
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPU];
+extern int32_t cpu_num;			// cpus running the kernel
+extern int32_t cpu_found;		// cpus listed by the MP table
+extern uint32_t ioapic_addr;	// first I/O APIC of the MP table, 0 if none
+extern uint8_t ioapic_id;
+extern uint8_t cpu_stack[MAX_CPU][CPU_STACK_SIZE];
+
+cpu_t* this_cpu(void);
+void smp_init(void);
+void smp_boot_aps(void);
+void ap_main(void);
+void smp_kick(int32_t cpu);
+void tlb_shootdown(void);
+void tlb_sync(void);
+
+#endif
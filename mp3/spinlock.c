@@ -0,0 +1,124 @@
+#include "spinlock.h"
+#include "smp.h"
+#include "procfs.h"
+
+/* every lock that was taken at least once, for the "locks" special file */
+static lock_stat_t* lock_list[LOCK_LIST_MAX];
+static volatile uint32_t lock_count;
+
+/*
+*   Function: spin_lock(spinlock_t* lock)
+*   Description: take the lock, spinning while another cpu holds it. A cpu that finds the lock
+*                held by itself would spin forever, that is reported instead.
+*   inputs: lock
+*   outputs: none
+*   effects: interrupts must be off
+*/
+void spin_lock(spinlock_t* lock)
+{
+	int32_t me = this_cpu()->id;
+	int32_t waited = 0;
+	uint32_t old;
+
+	while (1) {
+		old = 1;
+		asm volatile("xchgl %0, %1" : "+r"(old), "+m"(lock->locked) : : "memory");
+		if (old == 0)
+			break;
+		if (lock->cpu == me) {
+			printf("spinlock %s taken twice on cpu %d\n", lock->stat.name, me);
+			while (1);
+		}
+		waited = 1;
+		while (lock->locked)
+			asm volatile("pause");
+	}
+	lock->cpu = me;
+	lock_stat_acquired(&lock->stat, waited);
+}
+
+/*
+*   Function: spin_unlock(spinlock_t* lock)
+*   Description: release the lock
+*   inputs: lock
+*   outputs: none
+*   effects: interrupts must be off
+*/
+void spin_unlock(spinlock_t* lock)
+{
+	lock_stat_released(&lock->stat);
+	lock->cpu = -1;
+	asm volatile("" : : : "memory");	// stores are not reordered on x86, only the compiler has to be held back
+	lock->locked = 0;
+}
+
+/*
+*   Function: lock_stat_acquired(lock_stat_t* stat, int32_t waited)
+*   Description: count an acquisition and start timing the hold. The first one puts the lock on
+*                the lock list.
+*   inputs: statistics of the lock, 1 if the caller had to wait for it
+*   outputs: none
+*   effects: the caller holds the lock
+*/
+void lock_stat_acquired(lock_stat_t* stat, int32_t waited)
+{
+	uint32_t slot = 1;
+
+	if (!stat->listed) {
+		stat->listed = 1;
+		asm volatile("lock; xaddl %0, %1" : "+r"(slot), "+m"(lock_count) : : "memory");
+		if (slot < LOCK_LIST_MAX)
+			lock_list[slot] = stat;
+	}
+	stat->acquired++;
+	if (waited)
+		stat->contended++;
+	rdtsc(stat->hold_start);
+}
+
+/*
+*   Function: lock_stat_released(lock_stat_t* stat)
+*   Description: add the hold that ends now to the hold times
+*   inputs: statistics of the lock
+*   outputs: none
+*   effects: the caller still holds the lock
+*/
+void lock_stat_released(lock_stat_t* stat)
+{
+	uint64_t now;
+	uint32_t held;
+
+	rdtsc(now);
+	held = (uint32_t)(now - stat->hold_start);
+	stat->hold_total += held;
+	if (held > stat->hold_max)
+		stat->hold_max = held;
+}
+
+/*
+*   Function: lock_stat_show()
+*   Description: print the statistics of every lock for the "locks" special file. HOLD is the total
+*                hold time in units of 2^20 tsc cycles, MAX the longest single hold in cycles.
+*   inputs: none
+*   outputs: none
+*   effects: the numbers are read without the locks and may be off by the holds in progress
+*/
+void lock_stat_show(void)
+{
+	lock_stat_t* stat;
+	uint32_t i, n;
+
+	n = (lock_count < LOCK_LIST_MAX) ? lock_count : LOCK_LIST_MAX;
+	proc_puts("LOCK      ACQUIRED CONTENDED     HOLD       MAX\n");
+	for (i = 0; i < n; i++) {
+		stat = lock_list[i];
+		if (stat == 0)
+			continue;
+		proc_puts(stat->name);
+		proc_putu(stat->acquired, 14 - strlen(stat->name));
+		proc_putu(stat->contended, 10);
+		proc_putu((uint32_t)(stat->hold_total >> 20), 9);
+		proc_putu(stat->hold_max, 10);
+		proc_puts("\n");
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+#include "lib.h"
+
+#define LOCK_LIST_MAX	32			// locks the "locks" special file can list
+
+/* how often a lock was taken and how long it was held, in tsc cycles */
+typedef struct lock_stat_t {
+	const int8_t* name;
+	uint32_t listed;				// set once the lock is in the lock list
+	uint32_t acquired;
+	uint32_t contended;				// acquisitions that had to wait for another holder
+	uint64_t hold_start;
+	uint64_t hold_total;
+	uint32_t hold_max;
+} lock_stat_t;
+
+/* Busy waiting lock. It is only ever held with interrupts off, so the holder
+ * cannot be preempted or interrupted by a handler that wants it too; take it
+ * with spin_lock_irqsave unless interrupts are known to be off already
+ * (interrupt handlers, or nested under another spinlock). */
+typedef struct spinlock_t {
+	volatile uint32_t locked;
+	int32_t cpu;					// holder, -1 when free
+	lock_stat_t stat;
+} spinlock_t;
+
+#define SPINLOCK_INIT(name)		{ 0, -1, { name, 0, 0, 0, 0, 0, 0 } }
+
+#define spin_lock_irqsave(lock, flags)		\
+do {										\
+	cli_and_save(flags);					\
+	spin_lock(lock);						\
+} while(0)
+
+#define spin_unlock_irqrestore(lock, flags)	\
+do {										\
+	spin_unlock(lock);						\
+	restore_flags(flags);					\
+} while(0)
+
+void spin_lock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+
+/* shared with the sleeping locks */
+void lock_stat_acquired(lock_stat_t* stat, int32_t waited);
+void lock_stat_released(lock_stat_t* stat);
+void lock_stat_show(void);
+
+#endif
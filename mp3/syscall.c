@@ -1,36 +1,128 @@
 #include "syscall.h"
+#include "syscall_linkage.h"
 
 
 #define MB_128 0x08000000
 #define MB_132 0x08400000
 #define _136MB 0x8800000
-int pid = -1;
 int pid_status[];
-uint8_t exe_ret = -1;
 typedef int32_t (*f_ptr)();   // function pointer
 
 //file operation
-int32_t* rtc_op[4] = { (int32_t*)rtc_read, (int32_t*)rtc_write, (int32_t*)rtc_open, (int32_t*)rtc_close };
-int32_t* terminal_op[4] = { (int32_t*)terminal_read, (int32_t*)terminal_write, (int32_t*)terminal_open, (int32_t*)terminal_close };
-int32_t* dir_op[4] = { (int32_t*)dir_read, (int32_t*)dir_write, (int32_t*)dir_open, (int32_t*)dir_close };
-int32_t* file_op[4] = { (int32_t*)file_read, (int32_t*)file_write, (int32_t*)file_open, (int32_t*)file_close };
+int32_t* rtc_op[5] = { (int32_t*)rtc_read, (int32_t*)rtc_write, (int32_t*)rtc_open, (int32_t*)rtc_close, (int32_t*)rtc_poll };
+int32_t* terminal_op[5] = { (int32_t*)terminal_read, (int32_t*)terminal_write, (int32_t*)terminal_open, (int32_t*)terminal_close, (int32_t*)terminal_poll };
+int32_t* dir_op[5] = { (int32_t*)dir_read, (int32_t*)dir_write, (int32_t*)dir_open, (int32_t*)dir_close, (int32_t*)poll_always };
+int32_t* file_op[5] = { (int32_t*)file_read, (int32_t*)file_write, (int32_t*)file_open, (int32_t*)file_close, (int32_t*)poll_always };
+int32_t* pipe_rd_op[5] = { (int32_t*)pipe_read, (int32_t*)pipe_bad_write, (int32_t*)pipe_open, (int32_t*)pipe_read_close, (int32_t*)pipe_read_poll };
+int32_t* pipe_wr_op[5] = { (int32_t*)pipe_bad_read, (int32_t*)pipe_write, (int32_t*)pipe_open, (int32_t*)pipe_write_close, (int32_t*)pipe_write_poll };
+int32_t* proc_op[5] = { (int32_t*)proc_read, (int32_t*)proc_write, (int32_t*)proc_open, (int32_t*)proc_close, (int32_t*)poll_always };
+int32_t* serial_op[5] = { (int32_t*)serial_read, (int32_t*)serial_write, (int32_t*)serial_open, (int32_t*)serial_close, (int32_t*)serial_poll };
 
 /*
 *  system_execute:
 *      DESCRIPTION:	   the system call attemps to load and execute a new program, handling off the processor
-*					   to the new program until it terminates.
+*					   to the new program until it terminates. A command "a | b" runs every stage in its
+*					   own process with the stdout of one stage piped into the stdin of the next.
 *      INPUT:          command
 *      OUTPUT:         -1    if command cannot be executed or
-*					   0-255 if the program executes a halt
+*					   0-255 if the program executes a halt (the last stage for a pipeline)
 */
 int32_t system_execute(const uint8_t* command)
 {
-	cli();
-	uint32_t esp;
-	uint32_t ebp;
+	uint8_t stage[BUFFER_SIZE + 1];
+	int32_t cur = current_pid();
+	pcb_t* pcb = Find_PCB(cur);
+	pcb_t* child_pcb;
+	uint32_t flags;
+	int32_t child;
+	int32_t in_pipe = -1;
+	int32_t out_pipe;
+	int32_t failed = 0;
+	int idx = 0;
+	int len;
+
+	if (command == NULL || command[0] == '\0') {
+		printBuf((uint8_t*)"Empty filename!!\n");
+		return -1;
+	} 
+	if (strlen((int8_t*)command) > BUFFER_SIZE) {  //buffer_size is 128
+		printBuf((uint8_t*)"Command too long!!\n");
+		return -1;
+	}
+
+	pcb->child_mask = 0;
+	pcb->child_pid = -1;
+	pcb->child_ret = -1;
+	while (1) {
+		//split off the next stage of the pipeline
+		len = 0;
+		while (command[idx] != '|' && command[idx] != '\0' && command[idx] != '\n') {
+			stage[len] = command[idx];
+			len++;
+			idx++;
+		}
+		stage[len] = '\0';
+
+		out_pipe = -1;
+		if (command[idx] == '|' && (out_pipe = pipe_create()) == -1) {
+			printBuf((uint8_t*)"Cannot create pipe!!\n");
+			failed = 1;
+			break;
+		}
+		child = process_create(stage, pcb->term, cur);
+		if (child == -1) {
+			if (out_pipe != -1) {
+				pipe_release(out_pipe, 0);
+				pipe_release(out_pipe, 1);
+			}
+			failed = 1;
+			break;
+		}
+
+		//connect stdin and stdout to the pipes around this stage
+		child_pcb = Find_PCB(child);
+		if (in_pipe != -1) {
+			child_pcb->file_array[0].f_op = pipe_rd_op;
+			child_pcb->file_array[0].inode = in_pipe;
+		}
+		if (out_pipe != -1) {
+			child_pcb->file_array[1].f_op = pipe_wr_op;
+			child_pcb->file_array[1].inode = out_pipe;
+		}
+		in_pipe = out_pipe;
+
+		//earlier stages may halt on other cpus meanwhile and clear their bits
+		spin_lock_irqsave(&sched_lock, flags);
+		pcb->child_mask |= 1 << child;
+		pcb->child_pid = child;
+		spin_unlock_irqrestore(&sched_lock, flags);
+		enqueue_process(child);
+		if (out_pipe == -1)
+			break;
+		idx++;
+	}
+	//nobody is left to read what the stage before the failure writes
+	if (failed && in_pipe != -1)
+		pipe_release(in_pipe, 0);
+
+	//sleep until every stage has halted
+	wait_event(&pcb->child_wq, pcb->child_mask == 0);
+	return failed ? -1 : pcb->child_ret;
+}
+
+/*
+*  process_create:
+*      DESCRIPTION:	   load a program into a new process on terminal term. The process is not queued,
+*					   it starts in user mode the first time the scheduler picks it after enqueue_process.
+*      INPUT:          command (file name and argument), terminal, parent pid (-1 for none)
+*      OUTPUT:         pid of the new process, -1 if command cannot be executed
+*/
+int32_t process_create(const uint8_t* command, int32_t term, int32_t parent)
+{
 	uint8_t args[BUFFER_SIZE];
 	uint8_t file[BUFFER_SIZE];
 	dentry_t dir_entry;
+	syscall_frame_t frame;
 	uint32_t elf;
 	uint8_t eip_buf[4];
 	int len_args = 0;
@@ -38,30 +130,13 @@ int32_t system_execute(const uint8_t* command)
 	int idx = 0;
 	int i;
 	int eip = 0;
+	int32_t cur = current_pid();
 
 	//init args and file array
 	for (i = 0; i < BUFFER_SIZE; i++) {
 		args[i] = '\0';
 		file[i] = '\0';
 	}
-	if (command == NULL || command[0] == '\0') {
-		printBuf((uint8_t*)"Empty filename!!\n");
-		return -1;
-	} 
-
-	//store the esp and ebp
-	asm volatile (
-		"movl %%esp, %0		\n\
-         movl %%ebp, %1"
-		:"=r"(esp), "=r"(ebp)
-		:
-		: "memory"
-		);
-
-	if (strlen((int8_t*)command) > BUFFER_SIZE) {  //buffer_size is 128
-		printBuf((uint8_t*)"Command too long!!\n");
-		return -1;
-	}
 	//parse file and args of command-------------------------------------------------------
 	while (command[idx] == ' ') { //parse command to check where the first char of file start
 		idx++;
@@ -104,76 +179,62 @@ int32_t system_execute(const uint8_t* command)
 		printBuf((uint8_t*)"Non executable!!\n");
 		return -1; 
 	}		
-	//check if we reach the max shells
-	if (pid >= SHELL_MAX_INDEX) {
+	//-----------------------------------------------------------------------------------------------------
+	//find a new pid
+	int new_pid = pid_alloc();
+	if (new_pid == -1) {
 		printBuf((uint8_t*)"Hit the maximum shell!!\n");
 		return -1;
 	}
-	//-----------------------------------------------------------------------------------------------------
-	//store the old pid and find a new pid
-	/*int temp_pid = terminal_pid[display_index];
-	for (i = 0; i <= SHELL_MAX_INDEX; i++) { 
-		if (pid_status[i] == 0) {
-			pid_status[i] = 1;
-			pid = i;
-			break;
-		}
-	}
-	terminal_pid[display_index] = pid;*/
-
-	int temp_pid;
-	if (init_flag == 1) {
-		temp_pid = terminal_pid[cur_index];
-		int i;
-		for (i = 0; i < 6; i++) {
-			if (pid_status[i] == 0) {
-				pid_status[i] = 1;
-				pid = i;
-				break;
-			}
-		}
-		terminal_pid[cur_index] = pid;
-	}
-	else {
-		temp_pid = terminal_pid[display_index];
-		int i;
-		for (i = 0; i < 6; i++) {
-			if (pid_status[i] == 0) {
-				pid_status[i] = 1;
-				pid = i;
-				break;
-			}
-		}
-		terminal_pid[display_index] = pid;
-	}
-	init_flag = 0;
-
-	// Set up paging
-	map_user_prog(pid);
+	init_user_prog(new_pid, image_end(dir_entry));
 
-	//-----------------------------------------------------------------------------------------------------
-	//load file into memory
+	//load file into the memory of the new process, then switch back to the caller's pages.
+	//The copy runs with interrupts on, mm_pid tells the scheduler which pages to map for us.
+	if (cur != -1)
+		Find_PCB(cur)->mm_pid = new_pid;
+	map_user_prog(new_pid);
 	file_loader(dir_entry,eip_buf);  // defined in file_system_driver
+	if (cur != -1) {
+		Find_PCB(cur)->mm_pid = cur;
+		map_user_prog(cur);
+	}
 	eip |= eip_buf[0];
 	eip |= eip_buf[1] << (8); //shift 8 bits
 	eip |= eip_buf[2] << (16); //shift 16 bits
 	eip |= eip_buf[3] << (24);//shift 24 bits
 	//-----------------------------------------------------------------------------------------------------
-	//set up the current pcb
-	pcb_t * pcb = Find_PCB(pid); 
-
 	//set up the pcb entry
-	pcb->cur_pid = pid;
-
-	pcb->esp = esp;
-	pcb->ebp = ebp;
-	//store the prev_pid's esp0 and ss0
-	pcb->esp0 = tss.esp0;
-	pcb->ss0 = tss.ss0;
-
-	//store prev_pid's pid
-	pcb->prev_pid = temp_pid;
-
+	pcb_t * pcb = Find_PCB(new_pid); 
+
+	pcb->cur_pid = new_pid;
+	pcb->state = TASK_RUNNING;
+	pcb->prev_pid = parent;
+	pcb->term = term;
+	pcb->cpu = this_cpu()->id;			// queued on the creating cpu
+	pcb->mm_pid = new_pid;
+	pcb->prio = 0;
+	pcb->nice = 0;
+	pcb->in_syscall = 1;				// leaves through the syscall exit path
+	pcb->user_tsc = 0;
+	pcb->kernel_tsc = 0;
+	pcb->nr_switches = 0;
+	pcb->nr_blocks = 0;
+	pcb->fpu_used = 0;
+	pcb->fpu_cpu = -1;
+	timer_init(&pcb->sleep_timer);
+	pcb->sig_pending = 0;
+	pcb->sig_active = 0;
+	for (i = 0; i < SIG_NUM; i++)
+		pcb->sig_handler[i] = 0;
+	strncpy((int8_t*)pcb->command_file, (int8_t*)file, buf_len - 1);
+	pcb->command_file[buf_len - 1] = '\0';
+	pcb->child_mask = 0;
+	pcb->child_pid = -1;
+	pcb->child_wq.waiters = 0;
+
+	for (i = fd_min; i < MAX_FILE_NUM; i++) {
+		pcb->file_array[i].flags = 0;
+	}
 	pcb->file_array[0].f_op = terminal_op;
 	pcb->file_array[1].f_op = terminal_op;
 	pcb->file_array[0].inode = 0;
@@ -183,103 +244,87 @@ int32_t system_execute(const uint8_t* command)
 	pcb->file_array[0].flags = 1;
 	pcb->file_array[1].flags = 1;
 	
+	//store the arg into pcb (for the system_get_args syscall)
 	for (i = 0; i < 32; i++) {
 		pcb->command_arg[i] = args[i];
 	}
 	pcb->command_arg_size = len_args;
 
-	//store the arg into pcb (for the system_get_args syscall)
-	
 	//-----------------------------------------------------------------------------------------------------
-	//context switch
-	asm volatile (
-				"leal halt_ret, %%eax		\n\
-				 movl %%eax, %0"
-				:"=m"(pcb->return_addr)
-				:
-				: "eax", "memory"
-				);
-	
-	//set the ss0 and esp0
-	tss.ss0 = KERNEL_DS;
-	tss.esp0 = EIGHT_MB - EIGHT_KB*pid;
-	
 	/* Set up the iret context. 
-	 * interrupt will be enable after iret by orl EFALGE value 
+	 * interrupt will be enable after iret by the EFLAGE value 
 	 */
-	
-	asm volatile ("	cli					\n\
-				  movw %0, %%ax			\n\
-				  movw %%ax, %%ds 		\n\
-				  pushl %0				\n\
-				  pushl %1 				\n\
-				  pushfl				\n\
-				  popl %%eax 			\n\
-				  orl %2, %%eax 		\n\
-				  pushl %%eax			\n\
-				  pushl %3 				\n\
-				  pushl %4 				\n\
-				  "
-				:
-				: "i"(USER_DS), "r"(USER_ESP), "r"(EFLAGE), "i"(USER_CS), "r"(eip)
-				: "eax", "memory"
-				);
-	asm volatile("iret"); 
-
-	asm volatile("halt_ret:"); //label for the halt
-
-	return exe_ret;
+	memset(&frame, 0, sizeof(syscall_frame_t));
+	frame.eip = eip;
+	frame.cs = USER_CS;
+	frame.eflags = EFLAGE;
+	frame.esp = USER_ESP;
+	frame.ss = USER_DS;
+	setup_process_stack(new_pid, &frame);
+
+	return new_pid;
 }
 
 /*
 *  system_halt:
-*      DESCRIPTION:		halt the task	
+*      DESCRIPTION:		halt the task with the status of the program
 *      INPUT:          status
-*      OUTPUT:         return 0 on success
+*      OUTPUT:         does not return
 *					   
 */
 int32_t system_halt(uint8_t status) 
 {
-	pcb_t* pcb = Find_PCB(terminal_pid[cur_index]);			// find the current pcb 
-															//reset paging
-	tss.esp0 = pcb->esp0;
-	tss.ss0 = pcb->ss0;
-	pid = pcb->cur_pid;
+	process_exit(status);
+	return 0;
+}
+
+/*
+*  process_exit:
+*      DESCRIPTION:		halt the task, wake the parent waiting in execute and give up the cpu for good.
+*						The shell at the root of a terminal is started again.
+*      INPUT:          status for execute, SIG_KILL_STATUS for a process killed by a signal
+*      OUTPUT:         does not return
+*					   
+*/
+void process_exit(int32_t status) 
+{
+	int32_t cur = current_pid();
+	pcb_t* pcb = Find_PCB(cur);			// find the current pcb 
+	pcb_t* parent;
+	uint32_t flags;
 
 	int i;
-	for (i = fd_min; i < MAX_FILE_NUM; i++)
+	for (i = 0; i < MAX_FILE_NUM; i++) {
+		if (pcb->file_array[i].flags != 0) {	// close files still open, pipe ends release their buffer
+			f_ptr func = (void*)pcb->file_array[i].f_op[3];
+			func(i);
+		}
 		pcb->file_array[i].flags = 0;	// reset flag to 0
+	}
     
-	pid_status[pid] = 0;				// exit shell
-	pid = pcb->prev_pid;
-	terminal_pid[cur_index] = pid;
-	
-	if (pid == -1) {
-		system_execute((uint8_t *) "shell");	
+	free_user_prog(cur);				// release the user pages
+	shm_exit(cur);
+
+	if (pcb->prev_pid == -1) {
+		//the new shell gets another pid, this kernel stack is still in use
+		i = process_create((uint8_t *) "shell", pcb->term, -1);
+		if (i != -1)
+			enqueue_process(i);
 	}
 
-	exe_ret = status;
-
-	map_user_prog(pid);
-
-
-	//jump to parent process
-	
-	asm volatile (
-				"movl %0, %%esp			\n\
-        		movl %1, %%ebp			\n\
-        		jmp *%2"
-		:
-	: "r"(pcb->esp), "r"(pcb->ebp), "r" (pcb->return_addr)
-		);
-
-	//jump to prev_pid process
-	/*
-	asm volatile("movl %0, %%esp"::"r"(pcb->esp));
-	asm volatile("movl %0, %%ebp"::"r"(pcb->ebp));
-	asm volatile("jmp *%0"::"r"(pcb->return_addr));*/
-
-	return 0;
+	//the pid is freed by the next context on this cpu, once this kernel stack is no longer in use
+	spin_lock_irqsave(&sched_lock, flags);
+	if (pcb->prev_pid != -1) {
+		parent = Find_PCB(pcb->prev_pid);
+		if (parent->child_mask & (1 << cur)) {
+			parent->child_mask &= ~(1 << cur);
+			if (parent->child_pid == cur)
+				parent->child_ret = status;
+			wake_up_locked(&parent->child_wq);
+		}
+	}
+	pcb->state = TASK_DEAD;
+	schedule_locked();
 }
 
 /*
@@ -292,8 +337,7 @@ int32_t system_halt(uint8_t status)
 
 int32_t read(int32_t fd, uint8_t * buf, int32_t nbytes) 
 {
-	sti();
-  	pcb_t* pcb = Find_PCB(pid);
+  	pcb_t* pcb = Find_PCB(current_pid());
   	if (fd > fd_max || fd < 0 || fd==1 || buf == NULL || pcb->file_array[fd].flags == 0)  //check if it is a valid fd, and it cannot do stdout when read
     	return -1;
 
@@ -310,7 +354,7 @@ int32_t read(int32_t fd, uint8_t * buf, int32_t nbytes)
 
 int32_t write(int32_t fd, const uint8_t * buf, int32_t nbytes) 
 {
-	pcb_t* pcb = Find_PCB(pid);
+	pcb_t* pcb = Find_PCB(current_pid());
   	uint8_t checkFlag = pcb->file_array[fd].flags;
   	if (fd > fd_max || fd < 0 || fd == 0 || buf == NULL || checkFlag == 0)  //check if it is a valid fd, and it cannot do stdin when write
     	return -1;
@@ -335,7 +379,26 @@ int32_t open(const uint8_t * filename)
   	uint32_t fd;
   	dentry_t dentry;
   	fd = fd_alloc();
-  	pcb_t* pcb = Find_PCB(pid);							// find the current pcb and check if the filename is valid or not
+  	pcb_t* pcb = Find_PCB(current_pid());							// find the current pcb and check if the filename is valid or not
+    int32_t proc = proc_lookup(filename);
+    if (proc != -1 && fd != -1)						// kernel generated special file
+    {
+      pcb->file_array[fd].f_op = proc_op;
+      pcb->file_array[fd].inode = proc;
+      pcb->file_array[fd].f_position = 0;
+      pcb->file_array[fd].flags = 1;
+      return fd;
+    }
+    if (fd != -1 && strncmp((int8_t*)filename, SERIAL_NAME, buf_len) == 0)	// COM1
+    {
+      if (serial_open() == -1)
+        return -1;
+      pcb->file_array[fd].f_op = serial_op;
+      pcb->file_array[fd].inode = 0;
+      pcb->file_array[fd].f_position = 0;
+      pcb->file_array[fd].flags = 1;
+      return fd;
+    }
   	if(read_dentry_by_name(filename,&dentry) == -1)
     	return -1;
  
@@ -346,7 +409,7 @@ int32_t open(const uint8_t * filename)
       pcb->file_array[fd].f_position = 0;
       pcb->file_array[fd].flags = 1;
 	  f_ptr func = (void*)(pcb->file_array[fd].f_op[2]);
-      func();
+      func(fd);
       return fd;
     }
     else if(dentry.filetype == 1)						// directory type file, setup file array and call the corresponding function
@@ -383,7 +446,7 @@ int32_t open(const uint8_t * filename)
 
 int32_t close(int32_t fd) {
 
-	pcb_t* pcb = Find_PCB(pid);
+	pcb_t* pcb = Find_PCB(current_pid());
 	uint8_t checkFlag = pcb->file_array[fd].flags;
 
 	if (fd < fd_min || fd >fd_max || checkFlag==0)		//check fd
@@ -396,6 +459,43 @@ int32_t close(int32_t fd) {
     return 0;	
 }
 
+/*
+*   int32_t pipe(int32_t* fds)
+*   	DESCRIPTION:	create a pipe, fds[0] becomes the read end and fds[1] the write end
+*   	INPUT:          user array for the two fds
+*		OUTPUT:         0 on success, -1 on failure
+*/
+
+int32_t pipe(int32_t* fds)
+{
+	pcb_t* pcb = Find_PCB(current_pid());
+	int32_t id, rd, wr;
+
+	if (check_user_range(fds, 2 * sizeof(int32_t), 1) == -1)
+		return -1;
+	rd = fd_alloc();
+	if (rd == -1)
+		return -1;
+	pcb->file_array[rd].flags = 1;			// hold rd while looking for the second fd
+	wr = fd_alloc();
+	id = (wr == -1) ? -1 : pipe_create();
+	if (id == -1) {
+		pcb->file_array[rd].flags = 0;
+		return -1;
+	}
+
+	pcb->file_array[rd].f_op = pipe_rd_op;
+	pcb->file_array[rd].inode = id;
+	pcb->file_array[rd].f_position = 0;
+	pcb->file_array[wr].f_op = pipe_wr_op;
+	pcb->file_array[wr].inode = id;
+	pcb->file_array[wr].f_position = 0;
+	pcb->file_array[wr].flags = 1;
+	fds[0] = rd;
+	fds[1] = wr;
+	return 0;
+}
+
 /*
 *   int32_t getargs(uint8_t * buf, int32_t nbytes)
 *   	DESCRIPTION:	get the argument from command line and put the nbytes of arguments into buf
@@ -404,7 +504,7 @@ int32_t close(int32_t fd) {
 */
 int32_t getargs(uint8_t * buf, int32_t nbytes) 
 {
-	pcb_t* pcb = Find_PCB(pid);
+	pcb_t* pcb = Find_PCB(current_pid());
   	if(buf==NULL||pcb->command_arg_size>nbytes)
     	return -1;
   	strcpy((int8_t*)buf,(int8_t*)pcb->command_arg);
@@ -422,38 +522,160 @@ int32_t getargs(uint8_t * buf, int32_t nbytes)
 int32_t vidmap(uint8_t ** screen_start) 
 {
 
-	if (screen_start == NULL || screen_start <= (uint8_t**) INVALID_ADDR)
+	if (check_user_range(screen_start, sizeof(uint8_t*), 1) == -1)
 		return -1;
-	map_video_mem((uint32_t)_256MB, (uint32_t)VIDEO+4096*2*cur_index);
+	map_video_mem((uint32_t)_256MB, (uint32_t)VIDEO+4096*2*current_term());
 	*screen_start = (uint8_t*)_256MB;
 
 	return 0;
 
 }
 
+/*
+*   int32_t system_fork(syscall_frame_t regs)
+*   	DESCRIPTION: 	duplicate the calling process. The child gets a copy of the pcb and fd table,
+*						shares the user pages copy-on-write and runs alongside the parent.
+*   	INPUT: 			the caller's registers as saved by syscall_linkage
+*		OUTPUT: 		0 in the child, the child's pid in the parent, -1 on failure
+*/
+int32_t system_fork(syscall_frame_t regs)
+{
+	int32_t parent = current_pid();
+	int32_t child, i;
+	pcb_t* parent_pcb;
+	pcb_t* child_pcb;
 
-int32_t set_handler(int32_t signum, void * handler_address) {
-	return -1;
+	child = pid_alloc();
+	if (child == -1)
+		return -1;
+
+	parent_pcb = Find_PCB(parent);
+	child_pcb = Find_PCB(child);
+	fpu_save_current();		// the child starts with the FPU registers of the parent
+	memcpy(child_pcb, parent_pcb, sizeof(pcb_t));
+
+	child_pcb->cur_pid = child;
+	child_pcb->prev_pid = parent;
+	child_pcb->mm_pid = child;
+	child_pcb->state = TASK_RUNNING;
+	child_pcb->child_mask = 0;
+	child_pcb->child_pid = -1;
+	child_pcb->child_wq.waiters = 0;
+	child_pcb->user_tsc = 0;
+	child_pcb->kernel_tsc = 0;
+	child_pcb->nr_switches = 0;
+	child_pcb->nr_blocks = 0;
+	child_pcb->fpu_cpu = -1;
+	timer_init(&child_pcb->sleep_timer);
+	child_pcb->sig_pending = 0;			// handlers are inherited, pending signals are not
+
+	fork_user_prog(parent, child);
+	shm_fork(parent, child);
+	for (i = 0; i < MAX_FILE_NUM; i++) {
+		if (child_pcb->file_array[i].flags != 0 && child_pcb->file_array[i].f_op == pipe_rd_op)
+			pipe_dup(child_pcb->file_array[i].inode, 0);
+		if (child_pcb->file_array[i].flags != 0 && child_pcb->file_array[i].f_op == pipe_wr_op)
+			pipe_dup(child_pcb->file_array[i].inode, 1);
+		if (child_pcb->file_array[i].flags != 0 && child_pcb->file_array[i].f_op == rtc_op)
+			rtc_dup(child, i);
+	}
+
+	//the child leaves this syscall with the parent's registers and eax = 0
+	setup_process_stack(child, &regs);
+	enqueue_process(child);
+
+	return child;
 }
 
-int32_t sigreturn(void) {
-	return -1;
+/*
+*   int32_t sbrk(int32_t increment)
+*   	DESCRIPTION: 	grow or shrink the heap of the calling process. New heap pages are zero
+*						filled by the page fault handler when they are first touched.
+*   	INPUT: 			number of bytes to add to the program break (may be negative)
+*		OUTPUT: 		the previous program break, -1 on failure
+*/
+int32_t sbrk(int32_t increment)
+{
+	int32_t cur = current_pid();
+	uint32_t old_brk = get_user_brk(cur);
+
+	if (set_user_brk(cur, old_brk + increment) == -1)
+		return -1;
+	return old_brk;
 }
 
 /**************** Helper Function ************************/
-pcb_t* Find_PCB(int pid)
+/*
+*   void setup_process_stack(int32_t p, const syscall_frame_t* frame)
+*   	DESCRIPTION: 	prepare the kernel stack of a new process like one switched out by context_switch,
+*						so the first switch to it returns through process_start_linkage to user level
+*   	INPUT: 			pid, user registers to start with
+*		OUTPUT: 		none
+*/
+void setup_process_stack(int32_t p, const syscall_frame_t* frame)
 {
-  return (pcb_t*)(EIGHT_MB - EIGHT_KB*(pid + 1));
+	syscall_frame_t* top = (syscall_frame_t*)(EIGHT_MB - EIGHT_KB*p) - 1;
+	uint32_t* esp = (uint32_t*)top;
+
+	memcpy(top, frame, sizeof(syscall_frame_t));
+	*(--esp) = (uint32_t)process_start_linkage;
+	*(--esp) = 0;		// ebp
+	*(--esp) = 0;		// ebx
+	*(--esp) = 0;		// esi
+	*(--esp) = 0;		// edi
+	Find_PCB(p)->sche_esp = (uint32_t)esp;
+}
+
+pcb_t* Find_PCB(int p)
+{
+  return (pcb_t*)(EIGHT_MB - EIGHT_KB*(p + 1));
+}
+
+/*
+*   int32_t current_pid()
+*   	DESCRIPTION: 	the running process is the owner of the kernel stack we are on. Interrupts stay on
+*						the stack they came in on, the idle stacks of the cpus and the boot stack before
+*						pid 0 exists belong to no process.
+*   	INPUT: 			none
+*		OUTPUT: 		pid, -1 for the idle task
+*/
+int32_t current_pid()
+{
+  uint32_t esp;
+  int32_t p;
+
+  asm volatile("movl %%esp, %0" : "=r"(esp));
+  if (esp >= EIGHT_MB || esp < EIGHT_MB - EIGHT_KB*MAX_PROCESS)
+    return -1;
+  p = (EIGHT_MB - 1 - esp) / EIGHT_KB;
+  return (pid_status[p] != 0) ? p : -1;
 }
 
 int32_t fd_alloc() {
 
+  pcb_t* pcb = Find_PCB(current_pid());
   int i;
   for (i = fd_min; i < MAX_FILE_NUM; i++) {
-    if ((Find_PCB(pid))->file_array[i].flags == 0)
+    if (pcb->file_array[i].flags == 0)
       return i; //return valid fd
   }
   return -1;  //no valid fd
 }
 
+int32_t pid_alloc() {
+
+  uint32_t flags;
+  int i;
+  spin_lock_irqsave(&sched_lock, flags);
+  for (i = 0; i < MAX_PROCESS; i++) {
+    if (pid_status[i] == 0) {
+      pid_status[i] = 1;
+      spin_unlock_irqrestore(&sched_lock, flags);
+      return i; //return valid pid
+    }
+  }
+  spin_unlock_irqrestore(&sched_lock, flags);
+  return -1;  //no free pid
+}
+
 
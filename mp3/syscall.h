@@ -11,6 +11,16 @@
 #include "interrupt_handlers.h"
 #include "paging.h"
 #include "scheduling.h"
+#include "shm.h"
+#include "pipe.h"
+#include "wait_queue.h"
+#include "procfs.h"
+#include "smp.h"
+#include "fpu.h"
+#include "serial.h"
+#include "timer.h"
+#include "poll.h"
+#include "signal.h"
 
 #define EXE_MAGIC_NUM 0x464c457f
 #define FOUR_MB 0x0400000 
@@ -21,7 +31,6 @@
 #define fd_min 2
 #define fd_max 7
 #define MAX_FILE_NUM 8
-#define SHELL_MAX_INDEX 5
 #define EFLAGE 0x200
 #define FILE_RTC 0
 #define FILE_DIR 1
@@ -31,9 +40,7 @@
 #define NOT_VALID 0x8048caf
 #define INVALID_ADDR 0x400000
 #define VIDEO 0xB8000
-int pid;
-uint8_t exe_ret;
-int pid_status[6];
+int pid_status[MAX_PROCESS];
 
 // file struct
 typedef struct file_t {
@@ -41,27 +48,66 @@ typedef struct file_t {
 	int32_t inode;
 	uint32_t f_position;
 	uint32_t flags;	
+	uint32_t rtc_div;				// RTC: hardware interrupts per tick of this file
+	uint32_t rtc_count;				// RTC: hardware interrupts left until its next tick
+	volatile uint32_t rtc_ticks;	// RTC: ticks so far
+	uint32_t rtc_seen;				// RTC: rtc_ticks at the last read, it is readable while they differ
 } file_t;
 
+// register frame left on the kernel stack by int $0x80 and syscall_linkage
+typedef struct syscall_frame {
+	uint32_t ebx;			// pushed by syscall_linkage
+	uint32_t ecx;
+	uint32_t edx;
+	uint32_t ebp;
+	uint32_t edi;
+	uint32_t esi;
+	uint32_t kernel_eflags;
+	uint32_t eip;			// pushed by the processor
+	uint32_t cs;
+	uint32_t eflags;
+	uint32_t esp;
+	uint32_t ss;
+} syscall_frame_t;
+
 // pcb structure
 typedef struct pcb {
 	int8_t cur_pid;
+	volatile int32_t state;	// TASK_RUNNING, TASK_BLOCKED on a wait queue or TASK_DEAD after halt
 	file_t file_array[MAX_FILE_NUM];
-	int8_t prev_pid;
+	int8_t prev_pid;		// parent, -1 for the shell at the root of a terminal
+	int8_t term;			// terminal the process runs on
+	int32_t cpu;			// cpu it runs on or last ran on, its run queue
+	int32_t mm_pid;			// pid whose user pages are mapped while it runs, execute loads a child through them
 	uint8_t command_file[buf_len];
 	uint8_t command_arg[buf_len];
 	int32_t command_arg_size;
-	uint32_t esp0;			
-	uint8_t ss0;	
-	uint32_t esp;			
-	uint32_t ebp;		
-	uint32_t return_addr;	
-	uint32_t sche_esp;
-	uint32_t sche_ebp;
+	int32_t ticks;			// left in the current time slice
+	int32_t prio;			// feedback queue level, 0 is the highest
+	int32_t nice;			// level the process returns to when it wakes up
+	int32_t in_syscall;		// cpu time is charged to kernel_tsc while set
+	uint64_t user_tsc;		// tsc cycles spent in user mode
+	uint64_t kernel_tsc;	// tsc cycles spent in syscalls
+	uint32_t nr_switches;	// times switched out
+	uint32_t nr_blocks;		// times switched out to sleep on a wait queue
+	uint32_t sche_esp;		// kernel stack saved by context_switch
+	uint32_t child_mask;	// children execute waits for, one bit per pid
+	int32_t child_pid;		// child whose halt status execute returns
+	int32_t child_ret;
+	wait_queue_t child_wq;	// execute sleeps here until its children halt
+	int32_t fpu_used;		// has FPU registers, saved in fpu_state while another process may use the FPU
+	int32_t fpu_cpu;		// cpu that last loaded them, -1 for none
+	uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+	timer_t sleep_timer;	// pending while the process sleeps in nanosleep
+	uint32_t sig_pending;	// signals sent and not delivered yet, one bit each
+	int32_t sig_active;		// a handler runs, the signals with a handler wait for its sigreturn
+	void* sig_handler[SIG_NUM];	// 0 for the default action
 } pcb_t;
 
 int32_t system_execute(const uint8_t* command);
 int32_t system_halt(uint8_t status);
+void process_exit(int32_t status);
+int32_t process_create(const uint8_t* command, int32_t term, int32_t parent);
 
 int32_t read(int32_t fd, uint8_t * buf, int32_t nbytes);
 int32_t write(int32_t fd, const uint8_t * buf, int32_t nbytes);
@@ -69,12 +115,19 @@ int32_t open(const uint8_t * filename);
 int32_t close(int32_t fd);
 int32_t getargs(uint8_t * buf, int32_t nbytes);
 int32_t vidmap(uint8_t ** screen_start);
-int32_t set_handler(int32_t signum, void * handler_address);
-int32_t sigreturn(void);
+int32_t system_fork(syscall_frame_t regs);
+int32_t sbrk(int32_t increment);
+int32_t pipe(int32_t* fds);
+
 
+extern int32_t* pipe_rd_op[5];
+extern int32_t* pipe_wr_op[5];
 
+void setup_process_stack(int32_t p, const syscall_frame_t* frame);
 int32_t fd_alloc();
-pcb_t* Find_PCB(int pid);
+int32_t pid_alloc();
+pcb_t* Find_PCB(int p);
+int32_t current_pid();
 
 
 #endif
@@ -3,6 +3,7 @@
 
 
 extern void syscall_linkage();
+extern void process_start_linkage();
 
 #endif
 
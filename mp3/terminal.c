@@ -22,7 +22,9 @@
 static char* video_mem = (char *)VIDEO; 
 static int keycount = 0;      // count the key entered into buffer
 uint8_t key_buf[BUFFER_SIZE][3];
-int32_t can_read;
+int32_t can_read[TERMINAL_NUM];			// a line was entered on the terminal and not read yet
+wait_queue_t terminal_wq[TERMINAL_NUM];	// readers waiting for a line on each terminal
+spinlock_t term_lock = SPINLOCK_INIT("term");
 static uint8_t temp;
 static uint8_t pre_ATTRIB;
 static int32_t s;
@@ -33,11 +35,10 @@ static int32_t s;
 *   Description: 
 *   inputs: target_sceen
 *   outputs: none
-*   effects: 
+*   effects: term_lock held (keyboard handler)
 */
 void screen_switch(uint32_t target_screen)
 {
-	cli();
 	//calculating the high byte and display to the screen
 	uint8_t high_byte = (SCREEN_SIZE*target_screen >> 8) & DISP_OFF;
 	outb(HB_OFF, VGA_BASE1);
@@ -54,7 +55,7 @@ void screen_switch(uint32_t target_screen)
 	//call paging and set up new pages for video mem
 	vid_new(VIDEO_MEM + 2 * SCREEN_SIZE * display_index, display_index);
 	update_cursor(y_screen[display_index],x_screen[display_index]);
-	sti();
+	wake_up(&terminal_wq[display_index]);	// a pending line may belong to this terminal
 	//send_eoi(1);
 }
 /*
@@ -62,27 +63,44 @@ void screen_switch(uint32_t target_screen)
 *   DESCRIPTION: read count bytes from keyboard
 *   INPUTS: int32_t fd, uint8_t* buf, int32_t nbytes
 *   OUTPUTS: none
-*   RETURN VALUE: int32_t count
+*   RETURN VALUE: int32_t count, -1 for a bad buffer or when a signal came first
 *   SIDE EFFECTS: fill the buf with content in out_buf
 */
 int32_t terminal_read(int32_t fd, uint8_t* buf, int32_t nbytes) 
 {
-	can_read = 0;
-	while (!can_read || display_index != cur_index);
-	can_read = 0;
+	uint32_t flags;
+	int32_t term = current_term();
+	int32_t ret;
+
+	//buf is filled under term_lock, a fault there could not be recovered
+	if (nbytes > 0 && check_user_range(buf, (nbytes < KEY_LIMIT) ? nbytes : KEY_LIMIT, 1) == -1)
+		return -1;
+	while (1) {
+		wait_event_interruptible(&terminal_wq[term], can_read[term] && display_index == term, ret);
+		if (ret == -1)			//a signal came first
+			return -1;
+		spin_lock_irqsave(&term_lock, flags);
+		if (can_read[term] && display_index == term)	//the screen may have switched since the wakeup
+			break;
+		spin_unlock_irqrestore(&term_lock, flags);
+	}
+	can_read[term] = 0;
 
 	uint32_t i, count;
-	if (nbytes <= 0)		//when nothing to be read
+	if (nbytes <= 0) {		//when nothing to be read
+		spin_unlock_irqrestore(&term_lock, flags);
 		return -1;
+	}
 	count = 0;
 	for (i = 0; i < nbytes && i<KEY_LIMIT; i++) {	//fill the buf 
-		buf[i] = key_buf[i][display_index];
+		buf[i] = key_buf[i][term];
 		if(buf[i]=='\n')
 			break;
 		count++;
 	}
 	count++;
 	clearBuffer();
+	spin_unlock_irqrestore(&term_lock, flags);
 	return count;
 }
 
@@ -91,17 +109,20 @@ int32_t terminal_read(int32_t fd, uint8_t* buf, int32_t nbytes)
 *   DESCRIPTION: write data to the terminal
 *   INPUTS: int32_t fd, uint8_t* buf, int32_t nbytes
 *   OUTPUTS: none
-*   RETURN VALUE: int32_t count
+*   RETURN VALUE: int32_t count, -1 for a bad buffer
 *   SIDE EFFECTS: print the keyboard command to the terminal
 */
 int32_t terminal_write(int32_t fd, const uint8_t* buf, int32_t nbytes) 
 {
-	if ((buf == NULL) || (nbytes < 0))	//if the buffer given to write is NULL or the end is reached, return -1
+	if (nbytes < 0 || check_user_range(buf, nbytes, 0) == -1)	//bad buffer, printC reads it under term_lock
 		return -1;
 
-	uint32_t i;
+	uint32_t i, flags;
+	spin_lock_irqsave(&term_lock, flags);
+	tlb_sync();							// video pages may have moved while interrupts were off
 	for (i = 0; i < nbytes; i++)
 		printC(buf[i]);					// print data stored in user buffer to screen
+	spin_unlock_irqrestore(&term_lock, flags);
 	return nbytes;
 }
 
@@ -131,6 +152,22 @@ int32_t terminal_close(int32_t fd)
 	return -1;		
 }
 
+/*
+* terminal_poll
+*   DESCRIPTION: readiness of the caller's terminal for poll
+*   INPUTS: fd, poll table
+*   OUTPUTS: none
+*   RETURN VALUE: POLLIN once a line waits and the terminal is on screen, POLLOUT always
+*   SIDE EFFECTS: none
+*/
+int32_t terminal_poll(int32_t fd, poll_table_t* pt)
+{
+	int32_t term = current_term();
+
+	poll_wait(pt, &terminal_wq[term]);
+	return ((can_read[term] && display_index == term) ? POLLIN : 0) | POLLOUT;
+}
+
 /*
 * keybrd_init
 *   DESCRIPTION: clear the screen and buffer
@@ -149,7 +186,8 @@ void keybrd_init()
 			key_buf[i][j] = 0;
 		}
 	}
-	can_read = 0;
+	for (j = 0; j < TERMINAL_NUM; j++)
+		can_read[j] = 0;
 	return;
 }
 
@@ -204,15 +242,16 @@ handle_scrolling(int type)
 {
 	if (type == 0) {
 		int32_t i;
+		int32_t term = current_term();
 		for (i = 0; i < (NUM_ROWS - 1) * NUM_COLS; i++) {		//shift video mem 1 row upwards
-			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*cur_index + (i << 1)) = *(uint8_t *)(video_mem + 2 * SCREEN_SIZE*cur_index + ((i + NUM_COLS) << 1));
-			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*cur_index + (i << 1) + 1) = ATTRIB;
+			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*term + (i << 1)) = *(uint8_t *)(video_mem + 2 * SCREEN_SIZE*term + ((i + NUM_COLS) << 1));
+			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*term + (i << 1) + 1) = ATTRIB;
 		}
 		for (i = (NUM_ROWS - 1) * NUM_COLS; i < TSIZE; i++) {	//empty the last row with all " " (space)
-			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*cur_index + (i << 1)) = ' ';
-			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*cur_index + (i << 1) + 1) = ATTRIB;
+			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*term + (i << 1)) = ' ';
+			*(uint8_t *)(video_mem + 2 * SCREEN_SIZE*term + (i << 1) + 1) = ATTRIB;
 		}
-		y_screen[cur_index]--;
+		y_screen[term]--;
 		return;
 	}
 	else {
@@ -295,11 +334,13 @@ void
 handle_wrap_around(int type)	//when the cursor reaches the end of terminal
 {
 	if (type == 0) {
-		y_screen[cur_index]++;
-		if (y_screen[cur_index] == NUM_ROWS)		//call handle scrolling when cursor reaches the bottom chck
+		int32_t term = current_term();
+
+		y_screen[term]++;
+		if (y_screen[term] == NUM_ROWS)		//call handle scrolling when cursor reaches the bottom chck
 			handle_scrolling(type);
-		x_screen[cur_index] %= NUM_COLS;
-		y_screen[cur_index] = (y_screen[cur_index] + (x_screen[cur_index] / NUM_COLS)) % NUM_ROWS;
+		x_screen[term] %= NUM_COLS;
+		y_screen[term] = (y_screen[term] + (x_screen[term] / NUM_COLS)) % NUM_ROWS;
 		return;
 	}
 	else {
@@ -347,21 +388,23 @@ void clearBuffer()
 void
 printC(uint8_t keystroke)
 {
+	int32_t term = current_term();
+
 	if (keystroke == '\n' || keystroke == '\r') { //newline char encountered
-		x_screen[cur_index] = 0;
-		y_screen[cur_index]++;
-		if (y_screen[cur_index] == NUM_ROWS)   //when y reaches the bottom of the screen
+		x_screen[term] = 0;
+		y_screen[term]++;
+		if (y_screen[term] == NUM_ROWS)   //when y reaches the bottom of the screen
 			handle_scrolling(0);
-		update_cursor(y_screen[cur_index], 0); //change the cursor location accordingly
+		update_cursor(y_screen[term], 0); //change the cursor location accordingly
 	}
 	//refer to lib.c
 	else {
-		*(uint8_t *)(video_mem + 2 *SCREEN_SIZE*cur_index + ((NUM_COLS*y_screen[cur_index] + x_screen[cur_index]) << 1)) = keystroke;
-		*(uint8_t *)(video_mem + 2 *SCREEN_SIZE*cur_index + ((NUM_COLS*y_screen[cur_index] + x_screen[cur_index]) << 1) + 1) = ATTRIB;
-		x_screen[cur_index]++;
-		if (x_screen[cur_index] == NUM_COLS)	//when x reaches the rightmost end of screen
+		*(uint8_t *)(video_mem + 2 *SCREEN_SIZE*term + ((NUM_COLS*y_screen[term] + x_screen[term]) << 1)) = keystroke;
+		*(uint8_t *)(video_mem + 2 *SCREEN_SIZE*term + ((NUM_COLS*y_screen[term] + x_screen[term]) << 1) + 1) = ATTRIB;
+		x_screen[term]++;
+		if (x_screen[term] == NUM_COLS)	//when x reaches the rightmost end of screen
 			handle_wrap_around(0);
-		update_cursor(y_screen[cur_index], x_screen[cur_index]);
+		update_cursor(y_screen[term], x_screen[term]);
 	}
 }
 
@@ -369,11 +412,15 @@ void printBuf(uint8_t* buf)
 {
 	int count = 0;
 	register uint32_t index = 0;
+	uint32_t flags;
+	spin_lock_irqsave(&term_lock, flags);
+	tlb_sync();
 	while (buf[index] != '\0') {
 		if(++count > 32) break; //break when the buf is overflow
 		printC(buf[index]);
 		index++;
 	}
+	spin_unlock_irqrestore(&term_lock, flags);
 }
 
 
@@ -3,6 +3,9 @@
 
 #include "lib.h"
 #include "i8259.h"
+#include "wait_queue.h"
+#include "spinlock.h"
+#include "poll.h"
 
 #define BUFFER_SIZE 128
 #define TERMINAL_NUM 3
@@ -15,8 +18,12 @@ extern int32_t terminal_read(int32_t fd, uint8_t* buf, int32_t nbytes);
 extern int32_t terminal_write(int32_t fd, const uint8_t* buf, int32_t nbytes);
 extern int32_t terminal_open();
 extern int32_t terminal_close(int32_t fd);
+extern int32_t terminal_poll(int32_t fd, poll_table_t* pt);
 extern void keybrd_init();
-extern int32_t can_read;
+extern int32_t can_read[TERMINAL_NUM];
+extern wait_queue_t terminal_wq[TERMINAL_NUM];
+/* guards the key buffer, the cursors and the video pages of the terminals */
+extern spinlock_t term_lock;
 
 //int can_read;
 uint8_t key_buf[BUFFER_SIZE][TERMINAL_NUM];
@@ -0,0 +1,276 @@
+#include "timer.h"
+#include "clock.h"
+#include "syscall.h"
+#include "wait_queue.h"
+
+/* Hierarchical timer wheel counting scheduler ticks of the tsc clock. Level l
+ * has 64 slots of 64^l ticks each, a timer goes into the lowest level that
+ * reaches its expiry. Whenever level 0 wraps around, the next slot of level 1
+ * is cascaded: its timers are put back by how far off they are now, level 0
+ * for the ones due within 64 ticks. Higher levels follow when the level below
+ * them wraps. Adding, removing and running a timer costs O(1), and a timer is
+ * cascaded at most TIMER_LEVELS - 1 times. Timers wake processes, so the wheel
+ * is guarded by sched_lock. Only TIMER_CPU runs it, from its timer interrupt,
+ * and keeps its one-shot armed for the next expiry (timer_arm). */
+static timer_t* wheel[TIMER_LEVELS][TIMER_SLOTS];
+static uint32_t wheel_now;			// last tick that was run
+static uint32_t wheel_count;		// pending timers
+
+/*
+*   Function: timer_init(timer_t* t)
+*   Description: set up a timer that is not pending
+*   inputs: timer
+*   outputs: none
+*   effects: none
+*/
+void timer_init(timer_t* t)
+{
+	t->next = 0;
+	t->pprev = 0;
+}
+
+/*
+*   Function: wheel_insert(timer_t* t)
+*   Description: link a timer into the slot for its expiry
+*   inputs: timer, expiring 0 to TIMER_RANGE - 1 ticks after wheel_now
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void wheel_insert(timer_t* t)
+{
+	uint32_t delta = t->expires - wheel_now;
+	uint32_t level = 0;
+	timer_t** slot;
+
+	while (level < TIMER_LEVELS - 1 && delta >= (1 << (TIMER_SLOT_BITS * (level + 1))))
+		level++;
+	slot = &wheel[level][(t->expires >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK];
+	t->next = *slot;
+	if (t->next != 0)
+		t->next->pprev = &t->next;
+	t->pprev = slot;
+	*slot = t;
+}
+
+/*
+*   Function: wheel_unlink(timer_t* t)
+*   Description: take a pending timer out of its slot
+*   inputs: timer
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void wheel_unlink(timer_t* t)
+{
+	*t->pprev = t->next;
+	if (t->next != 0)
+		t->next->pprev = t->pprev;
+	t->next = 0;
+	t->pprev = 0;
+}
+
+/*
+*   Function: wheel_cascade(uint32_t level)
+*   Description: redistribute the slot of a level that wheel_now just reached
+*   inputs: level, at least 1
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void wheel_cascade(uint32_t level)
+{
+	uint32_t idx = (wheel_now >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK;
+	timer_t* t = wheel[level][idx];
+	timer_t* next;
+
+	wheel[level][idx] = 0;
+	for (; t != 0; t = next) {
+		next = t->next;
+		wheel_insert(t);
+	}
+}
+
+/*
+*   Function: timer_add_locked(timer_t* t, uint32_t expires, void (*func)(uint32_t data), uint32_t data)
+*   Description: run func(data) at the tick expires, the next tick if that has passed. Expiries
+*                beyond the reach of the wheel are cut short, the caller checks the time again.
+*   inputs: timer that is not pending, tick, function and its argument
+*   outputs: none
+*   effects: sched_lock held, on another cpu TIMER_CPU has to be kicked to arm for it
+*/
+void timer_add_locked(timer_t* t, uint32_t expires, void (*func)(uint32_t data), uint32_t data)
+{
+	if (wheel_count == 0)			// the wheel stands still while it is empty
+		wheel_now = clock_tick_of(clock_ns());
+	if ((int32_t)(expires - wheel_now) < 1)
+		expires = wheel_now + 1;
+	if (expires - wheel_now >= TIMER_RANGE)
+		expires = wheel_now + TIMER_RANGE - 1;
+	t->expires = expires;
+	t->func = func;
+	t->data = data;
+	wheel_insert(t);
+	wheel_count++;
+}
+
+/*
+*   Function: timer_del_locked(timer_t* t)
+*   Description: cancel a timer
+*   inputs: timer
+*   outputs: 1 if it was pending, 0 if it ran already or was never added
+*   effects: sched_lock held
+*/
+int32_t timer_del_locked(timer_t* t)
+{
+	if (t->pprev == 0)
+		return 0;
+	wheel_unlink(t);
+	wheel_count--;
+	return 1;
+}
+
+/*
+*   Function: timer_run_locked()
+*   Description: advance the wheel to the current tick, cascading and running every timer that
+*                expired on the way
+*   inputs: none
+*   outputs: none
+*   effects: sched_lock held, called by the timer interrupt of TIMER_CPU
+*/
+void timer_run_locked(void)
+{
+	uint32_t now = clock_tick_of(clock_ns());
+	uint32_t level;
+	timer_t* t;
+
+	if (wheel_count == 0) {
+		wheel_now = now;
+		return;
+	}
+	while ((int32_t)(now - wheel_now) > 0) {
+		wheel_now++;
+		for (level = 1; level < TIMER_LEVELS && ((wheel_now >> (TIMER_SLOT_BITS * (level - 1))) & TIMER_SLOT_MASK) == 0; level++)
+			wheel_cascade(level);
+		while ((t = wheel[0][wheel_now & TIMER_SLOT_MASK]) != 0) {
+			wheel_unlink(t);
+			wheel_count--;
+			t->func(t->data);
+		}
+	}
+}
+
+/*
+*   Function: timer_next_locked(uint32_t max)
+*   Description: ticks from now until the wheel needs to run, the first timer of level 0 or the
+*                next cascade, whichever comes first
+*   inputs: most ticks the caller can wait
+*   outputs: 1 to max, 0 if no timer is pending
+*   effects: sched_lock held
+*/
+uint32_t timer_next_locked(uint32_t max)
+{
+	uint32_t now, tick;
+	int32_t n;
+
+	if (wheel_count == 0)
+		return 0;
+	now = clock_tick_of(clock_ns());
+	for (tick = wheel_now + 1; (int32_t)(tick - now) < (int32_t)max; tick++) {
+		if (wheel[0][tick & TIMER_SLOT_MASK] != 0 || (tick & TIMER_SLOT_MASK) == 0)
+			break;
+	}
+	n = tick - now;
+	return (n < 1) ? 1 : n;
+}
+
+/*
+*   Function: timer_wake(uint32_t p)
+*   Description: timer function of a sleeping process
+*   inputs: pid
+*   outputs: none
+*   effects: sched_lock held
+*/
+static void timer_wake(uint32_t p)
+{
+	if (Find_PCB(p)->state == TASK_BLOCKED)
+		wake_process(p);
+}
+
+/*
+*   Function: sleep_timeout_locked(uint64_t target)
+*   Description: block the running process until the clock reaches target or something else wakes
+*                it. The timer runs at the start of the first tick after target, so the sleep is
+*                at most one tick too long. A target beyond the reach of the wheel wakes early.
+*   inputs: nanoseconds since boot
+*   outputs: none
+*   effects: sched_lock held, other processes run meanwhile
+*/
+void sleep_timeout_locked(uint64_t target)
+{
+	int32_t cur = current_pid();
+	pcb_t* pcb = Find_PCB(cur);
+	uint64_t limit = clock_ns() + (uint64_t)(TIMER_RANGE / 2) * TICK_NS;
+
+	timer_add_locked(&pcb->sleep_timer, clock_tick_of(((target < limit) ? target : limit) + TICK_NS - 1),
+		timer_wake, cur);
+	pcb->state = TASK_BLOCKED;
+	if (this_cpu()->id != TIMER_CPU)	// on TIMER_CPU schedule_locked arms for it
+		smp_kick(TIMER_CPU);
+	schedule_locked();
+	timer_del_locked(&pcb->sleep_timer);
+}
+
+/*
+*   Function: sleep_until(uint64_t target)
+*   Description: block the running process until the clock reaches target or a signal comes
+*   inputs: nanoseconds since boot
+*   outputs: nanoseconds left when a signal cut the sleep short, 0 otherwise
+*   effects: other processes run meanwhile
+*/
+static uint64_t sleep_until(uint64_t target)
+{
+	uint64_t now;
+	uint32_t flags;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	while ((now = clock_ns()) < target && !signal_pending_locked())
+		sleep_timeout_locked(target);
+	spin_unlock_irqrestore(&sched_lock, flags);
+	return (now < target) ? target - now : 0;
+}
+
+/*
+*   int32_t sleep(uint32_t seconds)
+*   	DESCRIPTION: 	block the caller for a number of seconds
+*   	INPUT: 			seconds
+*		OUTPUT: 		0, the seconds left, rounded up, when a signal cut the sleep short
+*/
+int32_t sleep(uint32_t seconds)
+{
+	uint64_t left = sleep_until(clock_ns() + (uint64_t)seconds * NS_PER_SEC);
+
+	return div_u64(left + NS_PER_SEC - 1, NS_PER_SEC);
+}
+
+/*
+*   int32_t nanosleep(const timespec_t* req, timespec_t* rem)
+*   	DESCRIPTION: 	block the caller for the time in req, rounded up to the next tick. A signal
+*   					cuts the sleep short, then the time left goes into rem unless it is 0.
+*   	INPUT: 			time to sleep, remaining time or NULL
+*		OUTPUT: 		0, -1 for a bad request or buffer, or a sleep cut short
+*/
+int32_t nanosleep(const timespec_t* req, timespec_t* rem)
+{
+	uint64_t left;
+
+	if (check_user_range(req, sizeof(timespec_t), 0) == -1 || req->tv_nsec >= NS_PER_SEC)
+		return -1;
+	if (rem != NULL && check_user_range(rem, sizeof(timespec_t), 1) == -1)
+		return -1;
+	left = sleep_until(clock_ns() + (uint64_t)req->tv_sec * NS_PER_SEC + req->tv_nsec);
+	if (left == 0)
+		return 0;
+	if (rem != NULL) {
+		rem->tv_sec = div_u64(left, NS_PER_SEC);
+		rem->tv_nsec = left - (uint64_t)rem->tv_sec * NS_PER_SEC;
+	}
+	return -1;
+}
@@ -0,0 +1,39 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+
+#define TIMER_LEVELS	4
+#define TIMER_SLOT_BITS	6
+#define TIMER_SLOTS		(1 << TIMER_SLOT_BITS)		// per level
+#define TIMER_SLOT_MASK	(TIMER_SLOTS - 1)
+#define TIMER_RANGE		(1 << (TIMER_SLOT_BITS * TIMER_LEVELS))	// ticks the wheel reaches ahead, about 46 hours
+#define TIMER_CPU		0			// the wheel is run and armed for by the boot cpu
+
+/* A pending timer is linked into one slot of the wheel, pprev is 0 while it is not. */
+typedef struct timer_t {
+	struct timer_t* next;
+	struct timer_t** pprev;
+	uint32_t expires;				// tick it runs at
+	void (*func)(uint32_t data);	// called with sched_lock held
+	uint32_t data;
+} timer_t;
+
+/* time argument of nanosleep */
+typedef struct timespec_t {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+} timespec_t;
+
+void timer_init(timer_t* t);
+void timer_add_locked(timer_t* t, uint32_t expires, void (*func)(uint32_t data), uint32_t data);
+int32_t timer_del_locked(timer_t* t);
+void timer_run_locked(void);
+uint32_t timer_next_locked(uint32_t max);
+void sleep_timeout_locked(uint64_t target);
+
+/* system calls */
+int32_t sleep(uint32_t seconds);
+int32_t nanosleep(const timespec_t* req, timespec_t* rem);
+
+#endif
@@ -0,0 +1,114 @@
+#include "trace.h"
+#include "lib.h"
+#include "smp.h"
+#include "procfs.h"
+
+/* Event trace. Every cpu reserves a slot with one atomic add and fills it,
+ * the ring keeps the last TRACE_EVENTS events and a read of the "trace"
+ * special file drains what it has not handed out yet. Tracing is compiled
+ * in and costs one test while it is off. */
+static trace_event_t trace_ring[TRACE_EVENTS];
+static volatile uint32_t trace_on;
+static volatile uint32_t trace_head;	// slots reserved so far
+static uint32_t trace_tail;				// slots drained so far
+static uint32_t trace_lost;				// overwritten before they were drained
+
+/*
+*   Function: trace(uint32_t type, uint32_t arg)
+*   Description: record an event of this cpu, stamped with the tsc
+*   inputs: event type, argument
+*   outputs: none
+*   effects: any context
+*/
+void trace(uint32_t type, uint32_t arg)
+{
+	trace_event_t* ev;
+	uint32_t flags, slot = 1;
+	cpu_t* cpu;
+
+	if (!trace_on)
+		return;
+	cli_and_save(flags);
+	asm volatile("lock; xaddl %0, %1" : "+r"(slot), "+m"(trace_head) : : "memory");
+	cpu = this_cpu();
+	ev = &trace_ring[slot & (TRACE_EVENTS - 1)];
+	rdtsc(ev->tsc);
+	ev->type = type;
+	ev->cpu = cpu->id;
+	ev->proc = cpu->cur_pid;
+	ev->arg = arg;
+	restore_flags(flags);
+}
+
+/*
+*   Function: trace_read(uint8_t* buf, int32_t nbytes)
+*   Description: read of the "trace" special file, copy out whole events not drained yet. Events
+*                that were overwritten meanwhile are counted as lost.
+*   inputs: buffer, its size
+*   outputs: bytes read, 0 when the ring is drained
+*   effects: called with the procfs lock, so there is one reader at a time
+*/
+int32_t trace_read(uint8_t* buf, int32_t nbytes)
+{
+	uint32_t head = trace_head;
+	uint32_t n, first;
+
+	if (nbytes < 0)
+		return -1;
+	if (head - trace_tail > TRACE_EVENTS) {
+		trace_lost += head - trace_tail - TRACE_EVENTS;
+		trace_tail = head - TRACE_EVENTS;
+	}
+	n = head - trace_tail;
+	if (n > nbytes / sizeof(trace_event_t))
+		n = nbytes / sizeof(trace_event_t);
+
+	// the ring may wrap within the part handed out
+	first = TRACE_EVENTS - (trace_tail & (TRACE_EVENTS - 1));
+	if (first > n)
+		first = n;
+	memcpy(buf, &trace_ring[trace_tail & (TRACE_EVENTS - 1)], first * sizeof(trace_event_t));
+	memcpy(buf + first * sizeof(trace_event_t), trace_ring, (n - first) * sizeof(trace_event_t));
+	trace_tail += n;
+	return n * sizeof(trace_event_t);
+}
+
+/*
+*   Function: trace_control(const uint8_t* buf, int32_t nbytes)
+*   Description: write to the "trace" special file: "on" and "off" switch tracing, "clear" drops
+*                the events not drained yet
+*   inputs: command, its length
+*   outputs: nbytes, -1 for an unknown command
+*   effects:
+*/
+int32_t trace_control(const uint8_t* buf, int32_t nbytes)
+{
+	if (nbytes >= 2 && strncmp((int8_t*)buf, "on", 2) == 0)
+		trace_on = 1;
+	else if (nbytes >= 3 && strncmp((int8_t*)buf, "off", 3) == 0)
+		trace_on = 0;
+	else if (nbytes >= 5 && strncmp((int8_t*)buf, "clear", 5) == 0)
+		trace_tail = trace_head;
+	else
+		return -1;
+	return nbytes;
+}
+
+/*
+*   Function: trace_show()
+*   Description: print the state of the ring for the "tracestat" special file
+*   inputs: none
+*   outputs: none
+*   effects:
+*/
+void trace_show(void)
+{
+	proc_puts(trace_on ? "tracing on\n" : "tracing off\n");
+	proc_puts("recorded");
+	proc_putu(trace_head, 10);
+	proc_puts("\npending");
+	proc_putu((trace_head - trace_tail > TRACE_EVENTS) ? TRACE_EVENTS : trace_head - trace_tail, 11);
+	proc_puts("\nlost");
+	proc_putu(trace_lost, 14);
+	proc_puts("\n");
+}
@@ -0,0 +1,30 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "types.h"
+
+#define TRACE_EVENTS	8192		// events the ring holds, a power of two
+
+/* event types */
+#define TRACE_SYSCALL_ENTER	1		// arg: syscall number
+#define TRACE_SYSCALL_EXIT	2		// arg: return value
+#define TRACE_SWITCH		3		// arg: next pid, -1 for the idle task
+#define TRACE_IRQ_ENTER		4		// arg: vector
+#define TRACE_IRQ_EXIT		5		// arg: vector
+#define TRACE_PAGE_FAULT	6		// arg: faulting address
+
+/* one event, 16 bytes as read from the "trace" special file (trace2json.py) */
+typedef struct __attribute__((packed)) trace_event_t {
+	uint64_t tsc;
+	uint8_t type;
+	uint8_t cpu;
+	int16_t proc;					// running process, -1 for the idle task
+	uint32_t arg;
+} trace_event_t;
+
+void trace(uint32_t type, uint32_t arg);
+int32_t trace_read(uint8_t* buf, int32_t nbytes);
+int32_t trace_control(const uint8_t* buf, int32_t nbytes);
+void trace_show(void);
+
+#endif
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+# Convert a drained kernel trace into Chrome trace JSON (chrome://tracing, Perfetto).
+#
+# In the kernel:  echo on > trace, run the workload, echo off > trace,
+#                 then copy the bytes read from "trace" to the host (serial).
+# On the host:    ./trace2json.py trace.bin trace.json [tsc MHz, default 1000]
+#
+# Each cpu is one process row. Syscalls are slices on the thread of the
+# kernel pid that made them, interrupts are slices on an "irq" thread, and
+# the process a cpu runs is a slice on a "running" thread.
+
+import json
+import struct
+import sys
+
+EVENT = struct.Struct("<QBBhI")        # trace_event_t: tsc, type, cpu, pid, arg
+SYSCALL_ENTER, SYSCALL_EXIT, SWITCH, IRQ_ENTER, IRQ_EXIT, PAGE_FAULT = range(1, 7)
+IRQ_TID = 1000
+RUN_TID = 1001
+IRQ_NAMES = {0x20: "timer", 0x21: "keyboard", 0x28: "rtc",
+             0xF0: "ipi tick", 0xF1: "ipi resched", 0xF2: "ipi tlb"}
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit("usage: trace2json.py trace.bin trace.json [tsc MHz]")
+    mhz = float(sys.argv[3]) if len(sys.argv) == 4 else 1000.0
+    data = open(sys.argv[1], "rb").read()
+    events = [EVENT.unpack_from(data, off) for off in range(0, len(data) - EVENT.size + 1, EVENT.size)]
+    events.sort(key=lambda e: e[0])
+    if not events:
+        sys.exit("no events")
+    base = events[0][0]
+
+    out = []
+    running = {}                       # cpu -> (pid, start) of the current "running" slice
+    cpus = set()
+    for tsc, kind, cpu, pid, arg in events:
+        ts = (tsc - base) / mhz
+        cpus.add(cpu)
+        if kind == SYSCALL_ENTER:
+            out.append({"ph": "B", "name": "syscall %d" % arg, "pid": cpu, "tid": pid, "ts": ts})
+        elif kind == SYSCALL_EXIT:
+            out.append({"ph": "E", "pid": cpu, "tid": pid, "ts": ts, "args": {"ret": struct.unpack("<i", struct.pack("<I", arg))[0]}})
+        elif kind == IRQ_ENTER:
+            out.append({"ph": "B", "name": IRQ_NAMES.get(arg, "vector 0x%x" % arg), "pid": cpu, "tid": IRQ_TID, "ts": ts})
+        elif kind == IRQ_EXIT:
+            out.append({"ph": "E", "pid": cpu, "tid": IRQ_TID, "ts": ts})
+        elif kind == SWITCH:
+            prev = running.get(cpu)
+            if prev is not None:
+                out.append({"ph": "X", "name": prev[0], "pid": cpu, "tid": RUN_TID, "ts": prev[1], "dur": ts - prev[1]})
+            next_pid = struct.unpack("<i", struct.pack("<I", arg))[0]
+            running[cpu] = ("idle" if next_pid == -1 else "pid %d" % next_pid, ts)
+        elif kind == PAGE_FAULT:
+            out.append({"ph": "i", "s": "t", "name": "page fault", "pid": cpu, "tid": pid, "ts": ts, "args": {"addr": "0x%x" % arg}})
+
+    for cpu in cpus:
+        out.append({"ph": "M", "name": "process_name", "pid": cpu, "args": {"name": "cpu %d" % cpu}})
+        out.append({"ph": "M", "name": "thread_name", "pid": cpu, "tid": IRQ_TID, "args": {"name": "irq"}})
+        out.append({"ph": "M", "name": "thread_name", "pid": cpu, "tid": RUN_TID, "args": {"name": "running"}})
+
+    with open(sys.argv[2], "w") as f:
+        json.dump({"traceEvents": out, "displayTimeUnit": "ns"}, f)
+
+
+if __name__ == "__main__":
+    main()
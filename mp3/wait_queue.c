@@ -0,0 +1,94 @@
+#include "wait_queue.h"
+#include "syscall.h"
+
+/*
+*   Function: sleep_on(wait_queue_t* wq)
+*   Description: block the running process on wq until wake_up is called on it. A blocked process
+*                is off the run queue, so it no longer eats a time slice.
+*                Must be called with sched_lock held, which is held again on return.
+*   inputs: wait queue
+*   outputs: none
+*   effects: other processes run until another process or an interrupt wakes us
+*/
+void sleep_on(wait_queue_t* wq)
+{
+	int32_t p = current_pid();
+
+	Find_PCB(p)->state = TASK_BLOCKED;
+	wq->waiters |= 1 << p;
+	schedule_locked();
+}
+
+/*
+*   Function: sleep_on_interruptible(wait_queue_t* wq)
+*   Description: sleep_on unless a signal is pending for the caller. A signal wakes the caller
+*                without taking it off wq, that happens here when it comes back.
+*   inputs: wait queue
+*   outputs: 0 after a sleep, -1 for a pending signal
+*   effects: sched_lock held
+*/
+int32_t sleep_on_interruptible(wait_queue_t* wq)
+{
+	if (signal_pending_locked()) {
+		wq->waiters &= ~(1 << current_pid());
+		return -1;
+	}
+	sleep_on(wq);
+	return 0;
+}
+
+/*
+*   Function: wake_up(wait_queue_t* wq)
+*   Description: put every process sleeping on wq back on the run queue
+*   inputs: wait queue
+*   outputs: none
+*   effects: safe to call from interrupt handlers
+*/
+void wake_up(wait_queue_t* wq)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	wake_up_locked(wq);
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/*
+*   Function: wake_up_locked(wait_queue_t* wq)
+*   Description: wake_up for a caller that holds sched_lock
+*   inputs: wait queue
+*   outputs: none
+*   effects: 
+*/
+void wake_up_locked(wait_queue_t* wq)
+{
+	uint32_t waiters = wq->waiters;
+	int i;
+
+	wq->waiters = 0;
+	for (i = 0; i < MAX_PROCESS; i++) {
+		if (!(waiters & (1 << i)))
+			continue;
+		if (Find_PCB(i)->state == TASK_BLOCKED)
+			wake_process(i);
+	}
+}
+
+/*
+*   Function: wake_up_some(wait_queue_t* wq, uint32_t mask)
+*   Description: wake only the processes of wq that are in mask, the others keep sleeping
+*   inputs: wait queue, one bit per pid
+*   outputs: none
+*   effects: safe to call from interrupt handlers
+*/
+void wake_up_some(wait_queue_t* wq, uint32_t mask)
+{
+	wait_queue_t woken;
+	uint32_t flags;
+
+	spin_lock_irqsave(&sched_lock, flags);
+	woken.waiters = wq->waiters & mask;
+	wq->waiters &= ~mask;
+	wake_up_locked(&woken);
+	spin_unlock_irqrestore(&sched_lock, flags);
+}
@@ -0,0 +1,52 @@
+#ifndef _WAIT_QUEUE_H
+#define _WAIT_QUEUE_H
+
+#include "types.h"
+#include "lib.h"
+#include "spinlock.h"
+
+/* process states */
+#define TASK_RUNNING	0
+#define TASK_BLOCKED	1
+#define TASK_DEAD		2		// halted, waiting for its last switch away
+
+/* set of processes sleeping on an event, one bit per pid */
+typedef struct wait_queue_t {
+	volatile uint32_t waiters;
+} wait_queue_t;
+
+/* scheduler lock, guards the run queues, the process states and every wait
+ * queue. Defined in scheduling.c. */
+extern spinlock_t sched_lock;
+
+/* Sleep until cond holds. The condition is tested under sched_lock so a
+ * wake_up from an interrupt handler or another cpu cannot slip in between
+ * the test and the sleep. */
+#define wait_event(wq, cond)					\
+do {											\
+	uint32_t _wait_flags;						\
+	spin_lock_irqsave(&sched_lock, _wait_flags);	\
+	while (!(cond))								\
+		sleep_on(wq);							\
+	spin_unlock_irqrestore(&sched_lock, _wait_flags);	\
+} while(0)
+
+/* wait_event that also ends for a signal the caller does not ignore. ret is
+ * 0 once cond holds, -1 for the signal, which the caller passes on. */
+#define wait_event_interruptible(wq, cond, ret)	\
+do {											\
+	uint32_t _wait_flags;						\
+	(ret) = 0;									\
+	spin_lock_irqsave(&sched_lock, _wait_flags);	\
+	while (!(cond) && (ret) == 0)				\
+		(ret) = sleep_on_interruptible(wq);		\
+	spin_unlock_irqrestore(&sched_lock, _wait_flags);	\
+} while(0)
+
+void sleep_on(wait_queue_t* wq);
+int32_t sleep_on_interruptible(wait_queue_t* wq);
+void wake_up(wait_queue_t* wq);
+void wake_up_locked(wait_queue_t* wq);
+void wake_up_some(wait_queue_t* wq, uint32_t mask);
+
+#endif